@@ -5,11 +5,23 @@
 #include <vector>
 
 #include "consts.hpp"
+#include "page_kernels.hpp"
 
 class IFillingStrategy {
  public:
   virtual ~IFillingStrategy() = default;
   [[nodiscard]] virtual uint8_t get_value_at(size_t index) const = 0;
+  // Length of the sequence get_value_at repeats.
+  [[nodiscard]] virtual size_t period() const = 0;
+
+  // Vectorised kernels for the strategy's content, built from one period.
+  [[nodiscard]] PageKernels kernels() const {
+    std::vector<uint8_t> pattern(period());
+    for (size_t i = 0; i < pattern.size(); ++i) {
+      pattern[i] = get_value_at(i);
+    }
+    return PageKernels(pattern.data(), pattern.size());
+  }
 };
 
 class AlphabeticalFillingStrategy final : public IFillingStrategy {
@@ -17,6 +29,8 @@ class AlphabeticalFillingStrategy final : public IFillingStrategy {
   [[nodiscard]] uint8_t get_value_at(const size_t index) const override {
     return 'a' + index % 26;
   }
+
+  [[nodiscard]] size_t period() const override { return 26; }
 };
 
 class PseudoRandomFillingStrategy final : public IFillingStrategy {
@@ -31,6 +45,8 @@ class PseudoRandomFillingStrategy final : public IFillingStrategy {
 //    return static_cast<uint8_t>((index * 2654435761u + seed) % 256);
     return 0xAA;
   }
+
+  [[nodiscard]] size_t period() const override { return 1; }
 };
 
 template <size_t PAGE_SIZE>
@@ -48,9 +64,8 @@ class MemoryBlock {
   }
 
   void fill() {
-    for (size_t i = 0; i < data.size(); ++i) {
-      data[i] = strategy->get_value_at(i);
-    }
+    strategy->kernels().fill(reinterpret_cast<char*>(data.data()), 0,
+                             data.size());
   }
 };
 
@@ -61,23 +76,26 @@ class MemoryBlockVerifier {
   const IFillingStrategy* strategy;
 
   MemoryBlockVerifier(const size_t page_count, const IFillingStrategy* strategy)
-      : page_count(page_count), strategy(strategy) {
-    if (strategy == nullptr) {
-      throw std::runtime_error("Filling strategy is not set");
-    }
-  }
+      : page_count(page_count),
+        strategy(strategy),
+        kernels(checked(strategy)->kernels()) {}
 
   [[nodiscard]] bool verify(const std::array<uint8_t, PAGE_SIZE>& page_content,
                             const size_t page_number) const {
     if (page_number >= page_count) {
       return false;
     }
-    for (size_t i = 0; i < PAGE_SIZE; ++i) {
-      if (page_content[i] !=
-          strategy->get_value_at(page_number * PAGE_SIZE + i)) {
-        return false;
-      }
+    return kernels.verify(reinterpret_cast<const char*>(page_content.data()),
+                          page_number * PAGE_SIZE, PAGE_SIZE);
+  }
+
+ private:
+  static const IFillingStrategy* checked(const IFillingStrategy* strategy) {
+    if (strategy == nullptr) {
+      throw std::runtime_error("Filling strategy is not set");
     }
-    return true;
+    return strategy;
   }
+
+  PageKernels kernels;
 };
@@ -48,10 +48,6 @@
 #define ALLOCATE_REGISTERED_BUFFERS 1
 #endif
 
-#ifndef STUPID_BUFFER_MODE
-#define STUPID_BUFFER_MODE 1
-#endif
-
 struct RequestData {
   size_t seq[2];
   int event_type;
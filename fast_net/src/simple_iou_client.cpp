@@ -121,6 +121,10 @@ void send_receive_data(size_t start_index, size_t end_index,
 
       auto [iovec, index] =
           buffer_pool.check_out(sizeof(RequestData) + sizeof(int32_t));
+      if (!iovec.iov_base) {
+        // Every send buffer is in flight, retry once completions return some.
+        break;
+      }
       auto* request_data_send = static_cast<RequestData*>(iovec.iov_base);
       request_data_send->buffer[0] = start_index + send_index;
       request_data_send->seq[0] = thread_index;
@@ -159,6 +163,9 @@ void send_receive_data(size_t start_index, size_t end_index,
 #endif
       auto checked_out_buf = buffer_pool.check_out(sizeof(RequestData) +
                                                    PAGE_SIZE * sizeof(int32_t));
+      if (!checked_out_buf.iovec.iov_base) {
+        break;
+      }
       auto* request_data_recv = (RequestData*)checked_out_buf.iovec.iov_base;
       request_data_recv->seq[0] = thread_index;
       request_data_recv->seq[1] = recv_req_num++;
@@ -247,7 +254,11 @@ void send_receive_data(size_t start_index, size_t end_index,
         }
       }
 
-      buffer_pool.check_in(data->buffer_size, data->registered_buffer_index);
+      // A zero-copy send holds its buffer until the notification that follows
+      // its result.
+      if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        buffer_pool.check_in(data->registered_buffer_index);
+      }
       count++;
     }
 
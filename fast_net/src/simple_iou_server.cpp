@@ -12,6 +12,7 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <thread>
 #include <vector>
@@ -62,9 +63,41 @@ bool event_loop(struct io_uring& ring, int client_socket, size_t client_num,
   size_t read_req_num = 0;
   size_t write_req_num = 0;
 
+  // Requests read while every response buffer was in flight, their reads are
+  // re-armed once they are answered.
+  std::deque<RequestData*> waiting;
+
+  // Answers the page request in req and reads the next request into it.
+  // Returns false if no response buffer is free.
+  auto respond = [&](RequestData* req) {
+    int32_t page_number;
+    memcpy(&page_number, req->buffer, sizeof(int32_t));
+
+    const auto [iovec, index] = buffer_pool.check_out(
+        sizeof(RequestData) + PAGE_SIZE * sizeof(int32_t));
+    if (!iovec.iov_base) {
+      return false;
+    }
+    auto* response = static_cast<RequestData*>(iovec.iov_base);
+    response->buffer_size = sizeof(RequestData) + PAGE_SIZE * sizeof(int32_t);
+    response->registered_buffer_index = index;
+    for (int i = 0; i < PAGE_SIZE; i++) {
+      response->buffer[i] = page_number;
+    }
+    add_write_request(ring, client_socket, client_num, write_req_num++,
+                      response);
+    add_read_request(ring, client_socket, client_num, read_req_num++, req);
+    io_uring_submit(&ring);
+    return true;
+  };
+
   for (int i = 0; i < RING_SIZE / 4; i++) {
     auto checked_out_buf = buffer_pool.check_out(sizeof(RequestData) +
                                                  PAGE_SIZE * sizeof(int32_t));
+    if (!checked_out_buf.iovec.iov_base) {
+      std::cout << "Buffer pool exhausted" << std::endl;
+      return false;
+    }
     auto* response =
         static_cast<RequestData*>(checked_out_buf.iovec.iov_base);
     response->buffer_size = sizeof(RequestData) + PAGE_SIZE * sizeof(int32_t);
@@ -104,27 +137,23 @@ bool event_loop(struct io_uring& ring, int client_socket, size_t client_num,
         std::cout << "Requested page number: " << page_number << std::endl;
 #endif
 
-        const auto [iovec, index] = buffer_pool.check_out(
-            sizeof(RequestData) + PAGE_SIZE * sizeof(int32_t));
-        auto* response =
-            static_cast<RequestData*>(iovec.iov_base);
-        response->buffer_size =
-            sizeof(RequestData) + PAGE_SIZE * sizeof(int32_t);
-        response->registered_buffer_index = index;
-        for (int i = 0; i < PAGE_SIZE; i++) {
-          response->buffer[i] = page_number;
+        if (!respond(req)) {
+          waiting.push_back(req);
         }
-        add_write_request(ring, client_socket, client_num, write_req_num++,
-                          response);
-        add_read_request(ring, client_socket, client_num, read_req_num++, req);
-        io_uring_submit(&ring);
         break;
       }
       case WRITE_EVENT:
 #if VERBOSE
         std::cout << "Write complete, keeping connection open" << std::endl;
 #endif
-        buffer_pool.check_in(req->buffer_size, req->registered_buffer_index);
+        // send_zc keeps the buffer until its notification, the CQE after the
+        // one flagged IORING_CQE_F_MORE.
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+          buffer_pool.check_in(req->registered_buffer_index);
+          if (!waiting.empty() && respond(waiting.front())) {
+            waiting.pop_front();
+          }
+        }
         break;
       default:
         std::cout << "Unknown event type: " << req->event_type << std::endl;
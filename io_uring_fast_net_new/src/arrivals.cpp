@@ -0,0 +1,58 @@
+#include "arrivals.hpp"
+
+#include <cmath>
+#include <iostream>
+
+ArrivalProcess::ArrivalProcess(const std::string& kind, const double rate_per_second, const int on_ms,
+                               const int off_ms, const uint64_t start_ns, const uint64_t seed)
+    : kind(CONSTANT), gap_ns(1e9 / rate_per_second), start_ns(start_ns), on_ns((uint64_t)on_ms * 1000000),
+      period_ns((uint64_t)(on_ms + off_ms) * 1000000), rng(seed), exponential(1.0)
+{
+    if (kind == "poisson")
+    {
+        this->kind = POISSON;
+    }
+    else if (kind == "onoff")
+    {
+        if (on_ns == 0)
+        {
+            std::cerr << "On/off arrivals need a positive on period, sending at a constant rate.\n";
+        }
+        else
+        {
+            this->kind = ON_OFF;
+            gap_ns = gap_ns * on_ns / period_ns;
+        }
+    }
+    if (gap_ns < 1)
+    {
+        std::cerr << "Arrivals closer than 1 ns apart, sending at 1e9 requests/s.\n";
+        gap_ns = 1;
+    }
+}
+
+uint64_t ArrivalProcess::next()
+{
+    switch (kind)
+    {
+    case POISSON:
+        offset_ns += exponential(rng) * gap_ns;
+        break;
+    case ON_OFF:
+        {
+            offset_ns += gap_ns;
+            const double phase = std::fmod(offset_ns, (double)period_ns);
+            // Requests falling into an off period move to the start of the next on period.
+            if (phase >= on_ns)
+            {
+                offset_ns += period_ns - phase;
+            }
+            break;
+        }
+    case CONSTANT:
+    default:
+        offset_ns += gap_ns;
+        break;
+    }
+    return start_ns + (uint64_t)offset_ns;
+}
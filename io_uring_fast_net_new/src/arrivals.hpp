@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+
+// Intended send times of an open-loop load generator, in CLOCK_MONOTONIC nanoseconds.
+//   constant: one request every 1 / rate.
+//   poisson:  exponentially distributed gaps with mean 1 / rate.
+//   onoff:    constant spacing during on_ms, silence during off_ms, the rate during on periods is raised so the
+//             average over a period stays at rate.
+class ArrivalProcess
+{
+public:
+    ArrivalProcess(const std::string& kind, double rate_per_second, int on_ms, int off_ms, uint64_t start_ns,
+                   uint64_t seed);
+
+    // Intended time of the next request. Gaps are summed exactly, the fractions of a nanosecond included, and
+    // are never below 1 ns, so the times always move forward.
+    uint64_t next();
+
+    uint64_t first() const { return start_ns; }
+
+private:
+    enum Kind
+    {
+        CONSTANT,
+        POISSON,
+        ON_OFF,
+    };
+
+    Kind kind;
+    double gap_ns;
+    double offset_ns = 0; // of the last intended time from start_ns
+    uint64_t start_ns;
+    uint64_t on_ns;
+    uint64_t period_ns;
+    std::mt19937_64 rng;
+    std::exponential_distribution<double> exponential;
+};
@@ -0,0 +1,266 @@
+#include "buffer_arena.hpp"
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+namespace
+{
+constexpr size_t BASE_PAGE = 4096;
+constexpr size_t HUGE_2M = 2UL << 20;
+constexpr size_t HUGE_1G = 1UL << 30;
+
+size_t round_up(const size_t value, const size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Highest NUMA node the kernel can have, from the last node of the "0-3" style list in sysfs.
+int highest_node(const int fallback)
+{
+    std::ifstream possible("/sys/devices/system/node/possible");
+    std::string list;
+    if (!std::getline(possible, list) || list.empty())
+    {
+        return fallback;
+    }
+    const size_t last = list.find_last_of(",-");
+    return std::stoi(last == std::string::npos ? list : list.substr(last + 1));
+}
+
+// Free pages of the hugetlb pool of page_size on node, -1 if sysfs does not tell.
+long free_huge_pages(const int node, const size_t page_size)
+{
+    std::ifstream free_pages("/sys/devices/system/node/node" + std::to_string(node) + "/hugepages/hugepages-" +
+                             std::to_string(page_size / 1024) + "kB/free_hugepages");
+    long count = -1;
+    if (!(free_pages >> count))
+    {
+        return -1;
+    }
+    return count;
+}
+}
+
+BufferArena::BufferArena(const size_t size, const std::string& huge_pages, const int node, const bool pin)
+    : size(size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    bool mapped = false;
+    if (huge_pages == "2m" || huge_pages == "1g")
+    {
+        const bool giant = huge_pages == "1g";
+        const size_t page_size = giant ? HUGE_1G : HUGE_2M;
+        // The hugetlb reservation is made from the pool of all nodes, a binding to a node that has too few free
+        // huge pages would only fail at the first fault, with SIGBUS.
+        const long free_pages = node >= 0 ? free_huge_pages(node, page_size) : -1;
+        if (free_pages >= 0 && (size_t)free_pages < round_up(size, page_size) / page_size)
+        {
+            std::cerr << "Buffer arena: node " << node << " has " << free_pages << " free " << huge_pages
+                      << " huge pages, falling back to transparent huge pages" << std::endl;
+        }
+        else
+        {
+            mapped = map_hugetlb(page_size, giant ? MAP_HUGE_1GB : MAP_HUGE_2MB);
+            if (!mapped)
+            {
+                perror("mmap buffer arena with MAP_HUGETLB, falling back to transparent huge pages");
+            }
+        }
+        if (!mapped)
+        {
+            mapped = map_thp();
+        }
+    }
+    else if (huge_pages == "thp")
+    {
+        mapped = map_thp();
+    }
+    else
+    {
+        mapped_size = round_up(size, BASE_PAGE);
+        void* result = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (result != MAP_FAILED)
+        {
+            mapping = data = (char*)result;
+            where.page_size = BASE_PAGE;
+            mapped = true;
+        }
+    }
+    if (!mapped)
+    {
+        perror("mmap buffer arena");
+        return;
+    }
+
+    // The policy only steers the faults that come after it, so it is set before anything touches the arena.
+    if (node >= 0)
+    {
+        // The mask covers every node the kernel may have. The kernel reads maxnode - 1 bits of it.
+        constexpr size_t WORD_BITS = sizeof(unsigned long) * 8;
+        std::vector<unsigned long> mask((std::max(highest_node(node), node) + WORD_BITS) / WORD_BITS, 0);
+        mask[node / WORD_BITS] |= 1UL << (node % WORD_BITS);
+        if (syscall(SYS_mbind, data, mapped_size - (data - mapping), MPOL_BIND, mask.data(),
+                    mask.size() * WORD_BITS + 1, 0) < 0)
+        {
+            perror("mbind buffer arena");
+        }
+        else
+        {
+            where.bound = true;
+        }
+    }
+
+    // The first touch allocates the pages, the lock then covers whole huge pages: locking part of one would split
+    // the mapping below huge page size and leave it on base pages.
+    memset(data, 0, size);
+    locked_size = round_up(size, transparent ? HUGE_2M : where.page_size);
+    if (pin)
+    {
+        locked = mlock(data, locked_size) == 0;
+        if (!locked)
+        {
+            perror("mlock buffer arena");
+        }
+    }
+
+    if (transparent && where.page_size == HUGE_2M && thp_bytes() < round_up(size, HUGE_2M))
+    {
+        // Only part of a THP arena got huge pages, the rest is on base pages.
+        where.page_size = BASE_PAGE;
+    }
+    const int first = resident_node(data);
+    const int last = resident_node(data + size - 1);
+    where.node = first == last ? first : -1;
+}
+
+BufferArena::~BufferArena()
+{
+    if (locked)
+    {
+        munlock(data, locked_size);
+    }
+    if (mapping)
+    {
+        munmap(mapping, mapped_size);
+    }
+}
+
+bool BufferArena::map_hugetlb(const size_t page_size, const int size_flag)
+{
+    mapped_size = round_up(size, page_size);
+    void* result = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | size_flag, -1, 0);
+    if (result == MAP_FAILED)
+    {
+        return false;
+    }
+    mapping = data = (char*)result;
+    where.page_size = page_size;
+    return true;
+}
+
+// A huge page can only back a 2 MiB aligned range, so the mapping is made one huge page larger and the arena
+// starts at its first aligned address.
+bool BufferArena::map_thp()
+{
+    mapped_size = round_up(size, HUGE_2M) + HUGE_2M;
+    void* result = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED)
+    {
+        return false;
+    }
+    mapping = (char*)result;
+    data = mapping + (round_up((size_t)mapping, HUGE_2M) - (size_t)mapping);
+    transparent = true;
+    if (madvise(data, round_up(size, HUGE_2M), MADV_HUGEPAGE) < 0)
+    {
+        perror("madvise buffer arena MADV_HUGEPAGE");
+        where.page_size = BASE_PAGE;
+        return true;
+    }
+    where.page_size = HUGE_2M;
+    return true;
+}
+
+// AnonHugePages of the arena's mapping in /proc/self/smaps, what THP actually gave us.
+size_t BufferArena::thp_bytes() const
+{
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool in_arena = false;
+    while (std::getline(smaps, line))
+    {
+        unsigned long start;
+        unsigned long end;
+        char dash;
+        std::istringstream header(line);
+        if (header >> std::hex >> start >> dash >> end && dash == '-')
+        {
+            in_arena = start <= (unsigned long)data && (unsigned long)data < end;
+            continue;
+        }
+        if (in_arena && line.rfind("AnonHugePages:", 0) == 0)
+        {
+            return std::stoul(line.substr(strlen("AnonHugePages:"))) * 1024;
+        }
+    }
+    return 0;
+}
+
+int BufferArena::resident_node(const char* address) const
+{
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, nullptr, 0, address, MPOL_F_NODE | MPOL_F_ADDR) < 0)
+    {
+        return -1;
+    }
+    return node;
+}
+
+int BufferArena::current_node()
+{
+    unsigned int cpu = 0;
+    unsigned int node = 0;
+    if (getcpu(&cpu, &node) < 0)
+    {
+        return 0;
+    }
+    return (int)node;
+}
+
+void BufferArena::save_placements(const std::string& filepath, const std::vector<Placement>& placements)
+{
+    std::ofstream ofs(filepath, std::ios::app);
+    if (!ofs)
+    {
+        std::cerr << "Error: Could not open file " << filepath << " for writing.\n";
+        return;
+    }
+    for (size_t i = 0; i < placements.size(); ++i)
+    {
+        ofs << "BUFFER_PAGE_SIZE_" << i << "=" << placements[i].page_size << "\n";
+        ofs << "BUFFER_NODE_" << i << "=" << placements[i].node << "\n";
+        ofs << "BUFFER_NODE_BOUND_" << i << "=" << placements[i].bound << "\n";
+    }
+}
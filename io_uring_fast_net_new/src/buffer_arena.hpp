@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Backing memory of a worker's registered buffers, one anonymous mapping that is placed before its first fault.
+// huge_pages picks the page size: "none" (base pages), "thp" (madvise(MADV_HUGEPAGE)), "2m" or "1g" (MAP_HUGETLB of
+// that size, falling back to THP when the hugetlb pool, or that of node, has too few pages). With a node >= 0 the
+// mapping is bound to that NUMA node with mbind, otherwise it lands wherever it is first touched. The arena is faulted
+// in, and locked with pin, before the constructor returns, so placement() tells where it really ended up.
+class BufferArena
+{
+public:
+    struct Placement
+    {
+        size_t page_size = 0; // smallest page backing the arena, 0 if it was never allocated
+        int node = -1; // node holding the arena, -1 if unknown or spread over several
+        bool bound = false; // whether the node is enforced with mbind
+    };
+
+    BufferArena(size_t size, const std::string& huge_pages, int node, bool pin);
+    ~BufferArena();
+
+    BufferArena(const BufferArena&) = delete;
+    BufferArena& operator=(const BufferArena&) = delete;
+
+    bool valid() const { return data != nullptr; }
+
+    char* base() const { return data; }
+
+    const Placement& placement() const { return where; }
+
+    // NUMA node of the CPU the calling thread runs on, 0 if it cannot be told.
+    static int current_node();
+
+    // Appends the placement of every worker's arena to a report _env file, as BUFFER_PAGE_SIZE_<thread>,
+    // BUFFER_NODE_<thread> and BUFFER_NODE_BOUND_<thread>.
+    static void save_placements(const std::string& filepath, const std::vector<Placement>& placements);
+
+private:
+    bool map_hugetlb(size_t page_size, int size_flag);
+    bool map_thp();
+    size_t thp_bytes() const;
+    int resident_node(const char* address) const;
+
+    size_t size;
+    size_t mapped_size = 0;
+    size_t locked_size = 0;
+    char* mapping = nullptr;
+    char* data = nullptr;
+    bool locked = false;
+    bool transparent = false;
+    Placement where;
+};
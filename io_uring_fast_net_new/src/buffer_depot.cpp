@@ -0,0 +1,212 @@
+#include "buffer_depot.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+BufferDepot::BufferDepot(const uint32_t buffer_size, const uint32_t buffer_count, const uint32_t magazine_size,
+                         const uint32_t caches, const std::string& huge_pages, const bool pin)
+    : buffer_size(buffer_size), buffer_count(buffer_count), magazine_size(magazine_size),
+      arena((size_t)buffer_size * buffer_count, huge_pages, -1, pin)
+{
+    if (buffer_count == 0 || magazine_size == 0)
+    {
+        std::cerr << "BufferDepot: needs at least one buffer and magazines of at least one." << std::endl;
+        return;
+    }
+    if (!arena.valid())
+    {
+        return;
+    }
+
+    const uint32_t filled = (buffer_count + magazine_size - 1) / magazine_size;
+    magazines = std::vector<Magazine>(filled + 3 * (size_t)caches);
+    slots.resize(magazines.size() * magazine_size);
+
+    for (uint32_t i = 0; i < buffer_count; ++i)
+    {
+        // Stored back to front, so that a fresh depot hands its buffers out in index order.
+        const uint32_t magazine = i / magazine_size;
+        const uint32_t round = std::min(magazine_size, buffer_count - magazine * magazine_size) - 1 - i % magazine_size;
+        rounds(magazine)[round] = i;
+        ++magazines[magazine].count;
+    }
+    for (uint32_t magazine = (uint32_t)magazines.size(); magazine > filled; --magazine)
+    {
+        push(empty, magazine - 1);
+    }
+    for (uint32_t magazine = filled; magazine > 0; --magazine)
+    {
+        push(full, magazine - 1);
+    }
+}
+
+void BufferDepot::push(Stack& stack, const uint32_t magazine)
+{
+    uint64_t head = stack.head.load(std::memory_order_relaxed);
+    uint64_t top;
+    do
+    {
+        magazines[magazine].next.store((uint32_t)head, std::memory_order_relaxed);
+        top = (((head >> 32) + 1) << 32) | magazine;
+    }
+    while (!stack.head.compare_exchange_weak(head, top, std::memory_order_release, std::memory_order_relaxed));
+}
+
+uint32_t BufferDepot::pop(Stack& stack)
+{
+    uint64_t head = stack.head.load(std::memory_order_acquire);
+    while (true)
+    {
+        const uint32_t magazine = (uint32_t)head;
+        if (magazine == NO_MAGAZINE)
+        {
+            return NO_MAGAZINE;
+        }
+        const uint64_t next = magazines[magazine].next.load(std::memory_order_relaxed);
+        if (stack.head.compare_exchange_weak(head, (((head >> 32) + 1) << 32) | next, std::memory_order_acquire,
+                                             std::memory_order_acquire))
+        {
+            return magazine;
+        }
+    }
+}
+
+// Partly filled magazines are only made by caches going away. Pushed as they are, every departing cache could
+// leave one behind and in the end hold the last empty magazine a cache needs to return a full one, so their
+// buffers go into the partly filled magazines the depot already has, or stay in one of its own.
+void BufferDepot::settle(const uint32_t magazine)
+{
+    while (true)
+    {
+        const uint32_t other = pop(full);
+        if (other == NO_MAGAZINE)
+        {
+            push(full, magazine);
+            return;
+        }
+        if (magazines[other].count == magazine_size)
+        {
+            push(full, other);
+            push(full, magazine);
+            return;
+        }
+        while (magazines[other].count < magazine_size && magazines[magazine].count > 0)
+        {
+            rounds(other)[magazines[other].count++] = rounds(magazine)[--magazines[magazine].count];
+        }
+        push(full, other);
+        if (magazines[magazine].count == 0)
+        {
+            push(empty, magazine);
+            return;
+        }
+    }
+}
+
+BufferDepot::Cache::Cache(BufferDepot& depot)
+    : depot(depot)
+{
+    loaded = depot.pop(depot.full);
+    if (loaded == NO_MAGAZINE)
+    {
+        loaded = depot.pop(depot.empty);
+    }
+    previous = depot.pop(depot.empty);
+    if (loaded == NO_MAGAZINE || previous == NO_MAGAZINE)
+    {
+        // Only if more caches exist than the depot was made for. The cache hands out nothing and loses what it
+        // is given, rather than share a magazine with another one.
+        std::cerr << "BufferDepot: no magazine left for another cache, the depot was made for fewer." << std::endl;
+        for (const uint32_t magazine : {loaded, previous})
+        {
+            if (magazine != NO_MAGAZINE)
+            {
+                depot.push(depot.magazines[magazine].count > 0 ? depot.full : depot.empty, magazine);
+            }
+        }
+        loaded = previous = NO_MAGAZINE;
+    }
+}
+
+BufferDepot::Cache::~Cache()
+{
+    if (loaded == NO_MAGAZINE)
+    {
+        return;
+    }
+    for (const uint32_t magazine : {loaded, previous})
+    {
+        const uint32_t count = depot.magazines[magazine].count;
+        if (count == 0)
+        {
+            depot.push(depot.empty, magazine);
+        }
+        else if (count == depot.magazine_size)
+        {
+            depot.push(depot.full, magazine);
+        }
+        else
+        {
+            depot.settle(magazine);
+        }
+    }
+}
+
+BufferDepot::Handle BufferDepot::Cache::take()
+{
+    if (loaded == NO_MAGAZINE)
+    {
+        return {};
+    }
+    if (depot.magazines[loaded].count == 0)
+    {
+        if (depot.magazines[previous].count > 0)
+        {
+            std::swap(loaded, previous);
+        }
+        else
+        {
+            const uint32_t magazine = depot.pop(depot.full);
+            if (magazine == NO_MAGAZINE)
+            {
+                return {};
+            }
+            ++trips;
+            depot.push(depot.empty, loaded);
+            loaded = magazine;
+        }
+    }
+    const uint32_t index = depot.rounds(loaded)[--depot.magazines[loaded].count];
+    return {depot.buffer(index), index};
+}
+
+void BufferDepot::Cache::give(const uint32_t index)
+{
+    if (loaded == NO_MAGAZINE)
+    {
+        std::cerr << "BufferDepot: cache without magazines, buffer " << index << " is lost." << std::endl;
+        return;
+    }
+    if (depot.magazines[loaded].count == depot.magazine_size)
+    {
+        if (depot.magazines[previous].count < depot.magazine_size)
+        {
+            std::swap(loaded, previous);
+        }
+        else
+        {
+            const uint32_t magazine = depot.pop(depot.empty);
+            if (magazine == NO_MAGAZINE)
+            {
+                // Only if more caches exist than the depot was made for.
+                std::cerr << "BufferDepot: no empty magazine left, buffer " << index << " is lost." << std::endl;
+                return;
+            }
+            ++trips;
+            depot.push(depot.full, loaded);
+            loaded = magazine;
+        }
+    }
+    depot.rounds(loaded)[depot.magazines[loaded].count++] = index;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "buffer_arena.hpp"
+
+// Equally sized buffers shared by several threads, so that a buffer received into on one thread can be sent, or
+// handed to any later stage, on another and then freed there. Built like the magazine layer of Bonwick's slab
+// allocator: every thread takes and returns buffers through a Cache of its own, which holds two magazines of up
+// to magazine_size buffer indices and touches nothing shared while one of them has a buffer (or room) to give.
+// Only when both are used up does it trade a whole magazine with the depot, two lock-free stacks of full and of
+// empty magazines, so the shared state is touched once per magazine_size buffers and never under a lock.
+//
+// All buffers live in one BufferArena. A ring that registers region() as a fixed buffer can read into or send
+// from any of them with read_fixed and send_zc_fixed at the handle's data, whichever thread took the buffer.
+class BufferDepot
+{
+public:
+    struct Handle
+    {
+        char* data = nullptr;
+        uint32_t index = 0; // of the buffer in the depot, data is base + index * buffer_size
+
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+    // A thread's front of the depot. Not thread-safe: each thread that takes or returns buffers has its own, and
+    // the depot must have been sized for all of them. Buffers may be returned through any cache, not just the one
+    // they were taken from. Destroying a cache returns its magazines and the buffers in them.
+    class Cache
+    {
+    public:
+        explicit Cache(BufferDepot& depot);
+        ~Cache();
+
+        Cache(const Cache&) = delete;
+        Cache& operator=(const Cache&) = delete;
+
+        // An empty handle once every buffer of the depot is taken, or if the depot had no magazines for the cache.
+        Handle take();
+
+        void give(uint32_t index);
+        void give(const Handle& handle) { give(handle.index); }
+
+        // Magazines traded with the depot, how often this cache touched shared state.
+        uint64_t depot_trips() const { return trips; }
+
+    private:
+        BufferDepot& depot;
+        uint32_t loaded;
+        uint32_t previous;
+        uint64_t trips = 0;
+    };
+
+    // caches is the most Cache objects that exist at a time, each of them may hold up to three magazines, so the
+    // depot keeps that many on top of the ones that hold the buffers. huge_pages and pin are as for BufferArena,
+    // the arena is not bound to a node since its buffers are meant to move between threads.
+    BufferDepot(uint32_t buffer_size, uint32_t buffer_count, uint32_t magazine_size, uint32_t caches,
+                const std::string& huge_pages, bool pin);
+
+    BufferDepot(const BufferDepot&) = delete;
+    BufferDepot& operator=(const BufferDepot&) = delete;
+
+    bool valid() const { return arena.valid() && buffer_count > 0 && magazine_size > 0; }
+
+    char* buffer(const uint32_t index) const { return arena.base() + (size_t)index * buffer_size; }
+
+    // The arena as it is registered, one iovec.
+    struct iovec region() const { return {arena.base(), (size_t)buffer_count * buffer_size}; }
+
+    uint32_t size() const { return buffer_size; }
+
+    const BufferArena::Placement& placement() const { return arena.placement(); }
+
+private:
+    static constexpr uint32_t NO_MAGAZINE = UINT32_MAX;
+
+    struct Magazine
+    {
+        // Link in the stack holding the magazine. A pop may read it while the magazine is being pushed again,
+        // the tag of the stack head then makes that pop fail.
+        std::atomic<uint32_t> next{NO_MAGAZINE};
+        uint32_t count = 0;
+    };
+
+    // A Treiber stack of magazine indices. The head packs a tag that every change bumps next to the top index, so
+    // a magazine popped and pushed back between another thread's read of the head and its exchange is noticed.
+    struct Stack
+    {
+        alignas(64) std::atomic<uint64_t> head{NO_MAGAZINE};
+    };
+
+    void push(Stack& stack, uint32_t magazine);
+    uint32_t pop(Stack& stack);
+    // Returns a partly filled magazine, topping up full ones with its buffers first.
+    void settle(uint32_t magazine);
+
+    uint32_t* rounds(const uint32_t magazine) { return &slots[(size_t)magazine * magazine_size]; }
+
+    uint32_t buffer_size;
+    uint32_t buffer_count;
+    uint32_t magazine_size;
+    BufferArena arena;
+    std::vector<Magazine> magazines;
+    std::vector<uint32_t> slots; // magazine_size buffer indices per magazine
+    Stack full; // magazines with buffers in them, mostly full ones
+    Stack empty;
+};
@@ -15,8 +15,19 @@
 #include <cerrno>
 #include <fstream>
 #include <ctime>
-#include <unordered_map>
-
+#include <algorithm>
+#include <deque>
+
+#include "arrivals.hpp"
+#include "buffer_arena.hpp"
+#include "connection_table.hpp"
+#include "crc32c.hpp"
+#include "latency_histogram.hpp"
+#include "metrics.hpp"
+#include "page_kernels.hpp"
+#include "page_protocol.hpp"
+#include "page_store.hpp"
+#include "ring_utils.hpp"
 #include "static_config.hpp"
 #include "thread_utils.hpp"
 
@@ -24,86 +35,86 @@ using namespace std;
 
 std::chrono::steady_clock::time_point client_start_time;
 
-struct Metrics {
-    double timestamp;
-    int64_t requests_completed;
-    double throughput; 
-    double gbit_per_second;
-};
+// Bytes of one request and of one response on the wire: 4 and page_size with PROTOCOL=echo, a GetPageRequest (a
+// GetPagesRequest with PAGE_RANGE_REQUESTS) and a GetPageResponseHeader plus the page with PROTOCOL=page.
+int request_size = 4;
+int response_size = 0;
+int response_header_size = 0;
 
 struct ThreadResult {
     int64_t total_requests_completed;
     int64_t total_bytes_sent;
     int64_t total_bytes_received;
     double duration;
-    std::vector<std::vector<Metrics>> per_second_metrics; 
+    std::vector<std::vector<MetricsRow>> per_second_metrics; 
+    LatencyHistogram latency;
+    BufferArena::Placement buffer_placement;
 };
 
-struct UserData {
-    uint32_t buffer_idx;
-    bool is_send;
-    uint16_t fd;
+// A range request that COALESCE_PAGES builds from the requests of several slots. It goes out on the connection and
+// in the send buffer of the slot that opened it, each page of its response completes the slot that asked for it.
+constexpr size_t MAX_OPEN_RANGES = 16;
+
+struct CoalescedRange {
+    uint32_t conn;
+    uint32_t send_slot;
+    uint32_t first_page;
+    uint32_t page_count;
+    uint32_t requests;
+    uint32_t pages_pending;
+    uint64_t opened; // when the first request joined
+    std::vector<int32_t> slots; // slot asking for each page of the range, -1 for the pages of a gap
 };
 
-uint64_t pack_user_data(const UserData& data) {
-    uint64_t result = 0;
-    result |= (uint64_t)(data.buffer_idx) & 0xFFFFFFFFULL; // bits 0..31
-    result |= ((uint64_t)(data.is_send ? 1 : 0) & 0x1ULL) << 32; // bit 32
-    result |= ((uint64_t)(data.fd) & 0xFFFFULL) << 33; // bits 33..48
-    return result;
+bool setup_io_uring(struct io_uring &ring, const int thread_id) {
+    return setup_ring(ring, 0, thread_id);
 }
 
-UserData unpack_user_data(uint64_t user_data) {
-    UserData data;
-    data.buffer_idx = (uint32_t)(user_data & 0xFFFFFFFFULL);
-    data.is_send = ((user_data >> 32) & 0x1ULL) != 0;
-    data.fd = (uint16_t)((user_data >> 33) & 0xFFFFULL);
-    return data;
+// Bytes of the send slots at the start of a thread's buffer arena, rounded up so the receive slots behind them
+// start on a page.
+size_t send_region_size() {
+    return ((size_t) config.inflight_ops * request_size + 4095) / 4096 * 4096;
 }
 
-bool setup_io_uring(struct io_uring &ring) {
-    int ret = io_uring_queue_init(config.queue_depth, &ring, 0);
-    if (ret) {
-        std::cerr << "io_uring_queue_init: " << strerror(-ret) << std::endl;
-        return false;
-    }
-    return true;
+size_t buffer_arena_size() {
+    return send_region_size() + (size_t) config.inflight_ops * response_size;
 }
 
-bool setup_buffers(struct io_uring &ring, char *&send_buffers, char *&recv_buffers) {
+// With aligned allocations the slots are carved from the thread's arena, which is already placed and pinned.
+bool setup_buffers(struct io_uring &ring, char *&send_buffers, char *&recv_buffers, const BufferArena &arena) {
     int ret;
 
     if (config.use_aligned_allocations) {
-        if (posix_memalign((void **) &send_buffers, 4096, config.inflight_ops * 4) != 0 ||
-            posix_memalign((void **) &recv_buffers, 4096, config.inflight_ops * config.page_size) != 0) {
-            perror("posix_memalign");
+        if (!arena.valid()) {
             io_uring_queue_exit(&ring);
             return false;
         }
+        send_buffers = arena.base();
+        recv_buffers = arena.base() + send_region_size();
     } else {
-        send_buffers = new char[config.inflight_ops * 4];
-        recv_buffers = new char[config.inflight_ops * config.page_size];
-    }
+        send_buffers = new char[config.inflight_ops * request_size];
+        recv_buffers = new char[config.inflight_ops * response_size];
 
-    if (config.alloc_pin) {
-        ret = mlock(send_buffers, config.inflight_ops * 4);
-        if (ret) {
-            perror("mlock send_buffers");
-        }
-        ret = mlock(recv_buffers, config.inflight_ops * config.page_size);
-        if (ret) {
-            perror("mlock recv_buffers");
+        if (config.alloc_pin) {
+            ret = mlock(send_buffers, config.inflight_ops * request_size);
+            if (ret) {
+                perror("mlock send_buffers");
+            }
+            ret = mlock(recv_buffers, config.inflight_ops * response_size);
+            if (ret) {
+                perror("mlock recv_buffers");
+            }
         }
     }
 
     struct iovec *iovecs = new struct iovec[config.inflight_ops * 2];
     for (int i = 0; i < config.inflight_ops; ++i) {
-        memcpy(send_buffers + i * 4, "TEST", 4);
-        iovecs[i].iov_base = send_buffers + i * 4;
-        iovecs[i].iov_len = 4;
+        memcpy(send_buffers + i * request_size, "TEST", 4);
+        iovecs[i].iov_base = send_buffers + i * request_size;
+        iovecs[i].iov_len = request_size;
 
-        iovecs[config.inflight_ops + i].iov_base = recv_buffers + i * config.page_size;
-        iovecs[config.inflight_ops + i].iov_len = config.page_size;
+        iovecs[config.inflight_ops + i].iov_base = recv_buffers + i * response_size;
+        iovecs[config.inflight_ops + i].iov_len = response_size;
     }
 
     ret = io_uring_register_buffers(&ring, iovecs, config.inflight_ops * 2);
@@ -112,12 +123,7 @@ bool setup_buffers(struct io_uring &ring, char *&send_buffers, char *&recv_buffe
     if (ret < 0) {
         std::cerr << "io_uring_register_buffers: " << strerror(-ret) << std::endl;
         io_uring_queue_exit(&ring);
-        if (config.use_aligned_allocations) {
-            munlock(send_buffers, config.inflight_ops * 4);
-            munlock(recv_buffers, config.inflight_ops * config.page_size);
-            free(send_buffers);
-            free(recv_buffers);
-        } else {
+        if (!config.use_aligned_allocations) {
             delete[] send_buffers;
             delete[] recv_buffers;
         }
@@ -130,74 +136,341 @@ bool setup_buffers(struct io_uring &ring, char *&send_buffers, char *&recv_buffe
 void cleanup_buffers(struct io_uring &ring, char *send_buffers, char *recv_buffers) {
     io_uring_queue_exit(&ring);
 
+    if (config.use_aligned_allocations) {
+        return;
+    }
+
     if (config.alloc_pin) {
-        munlock(send_buffers, config.inflight_ops * 4);
-        munlock(recv_buffers, config.inflight_ops * config.page_size);
+        munlock(send_buffers, config.inflight_ops * request_size);
+        munlock(recv_buffers, config.inflight_ops * response_size);
     }
+    delete[] send_buffers;
+    delete[] recv_buffers;
+}
 
-    if (config.use_aligned_allocations) {
-        free(send_buffers);
-        free(recv_buffers);
+// Both queue the message of slot buffer_index from byte offset on, the rest of it after a partial transfer.
+bool queue_request(struct io_uring &ring, const ConnectionTable &connections, const uint32_t conn,
+                   const uint32_t buffer_index, char *send_buffers, const uint32_t offset = 0) {
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    if (!sqe) {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    io_uring_prep_send(sqe, connections.fd_of(conn), send_buffers + buffer_index * request_size + offset,
+                       request_size - offset, MSG_WAITALL);
+    connections.flag_fixed(sqe);
+    sqe->user_data = connections.user_data(conn, OP_SEND, buffer_index);
+    return true;
+}
+
+bool queue_response(struct io_uring &ring, const ConnectionTable &connections, const uint32_t conn,
+                    const uint32_t buffer_index, char *recv_buffers, const uint32_t offset = 0) {
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    if (!sqe) {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    char *target = recv_buffers + buffer_index * response_size + offset;
+    if (config.half_duplex_mode) {
+        io_uring_prep_read_fixed(sqe, connections.fd_of(conn), target, response_size - offset, 0,
+                                 config.inflight_ops + buffer_index);
     } else {
-        delete[] send_buffers;
-        delete[] recv_buffers;
+        // MSG_WAITALL has the kernel keep receiving until the response is complete, a completion still comes up
+        // short when the receive is interrupted and is then continued from where it stopped. With PROTOCOL=page
+        // this is the only receive of the connection, so the bytes of a response always land in one buffer.
+        io_uring_prep_recv(sqe, connections.fd_of(conn), target, response_size - offset, MSG_WAITALL);
     }
+    connections.flag_fixed(sqe);
+    sqe->user_data = connections.user_data(conn, OP_RECV, buffer_index);
+    return true;
 }
 
 void client_handle_connection(const int thread_id, ThreadResult &result, struct io_uring &ring,
-                              char *send_buffers, char *recv_buffers, std::vector<int>& connections,
-                              std::unordered_map<int, int>& fd_to_conn_index) {
+                              char *send_buffers, char *recv_buffers, ConnectionTable &connections,
+                              std::vector<SharedLatencyHistogram> &latencies) {
     int ret;
     int inflight = 0;
-    int64_t total_requests_completed = 0;
 
-    int num_connections = connections.size();
+    // When each slot's current request was queued, its response completes the round trip. In open-loop mode this is
+    // the time the request was meant to go out, so time spent waiting for a free slot counts as latency.
+    std::vector<uint64_t> send_times(config.inflight_ops, 0);
+
+    const bool open_loop = config.load_mode == "open" && !config.half_duplex_mode;
+    ArrivalProcess arrivals(config.arrival_process, config.target_rate / config.thread_count, config.onoff_on_ms,
+                            config.onoff_off_ms, monotonic_ns(), thread_id + 1);
+    uint64_t next_arrival = arrivals.first();
+    const uint64_t arrivals_end = next_arrival + (uint64_t)config.run_duration_seconds * 1000000000ULL;
+    std::vector<uint32_t> free_slots;
+    std::deque<uint64_t> backlog; // intended send times still waiting for a free slot
+    int64_t requests_dropped = 0;
+    struct __kernel_timespec timer_ts = {};
+    int64_t total_requests_completed = 0;
 
-    std::vector<int64_t> total_bytes_sent(num_connections, 0);
-    std::vector<int64_t> total_bytes_received(num_connections, 0);
-    std::vector<int64_t> bytes_sent_since_last_report(num_connections, 0);
-    std::vector<int64_t> bytes_received_since_last_report(num_connections, 0);
-    std::vector<int64_t> requests_completed_since_last_report(num_connections, 0);
-    std::vector<int64_t> requests_completed(num_connections, 0);
+    // PROTOCOL=page request ids carry the slot in their low bits, the sequence number of the slot's request above,
+    // so a response finds its request in O(1) whatever order the server answers in.
+    const bool page_protocol = config.protocol == "page";
+    int slot_bits = 0;
+    while ((1 << slot_bits) < config.inflight_ops) {
+        ++slot_bits;
+    }
+    const uint32_t slot_mask = (1u << slot_bits) - 1;
+    std::vector<uint32_t> request_ids(config.inflight_ops, 0);
+    std::vector<uint32_t> request_pages(config.inflight_ops, 0);
+    // Pages a slot's request asked for and those still to come, a range request completes with its last page.
+    std::vector<uint32_t> request_counts(config.inflight_ops, 1);
+    std::vector<uint32_t> pages_pending(config.inflight_ops, 1);
+    uint32_t next_page = 0;
+    int64_t responses_failed = 0;
+    // VERIFY_PAGES checks every successful response against the generated dataset the server serves.
+    const PageKernels kernels = PageKernels::pseudo_random(PageStore::PAGE_SEED);
+    int64_t pages_verified = 0;
+    int64_t pages_corrupt = 0;
+    int64_t checksum_mismatches = 0;
+    // Bytes of each slot's request already sent and of its response already received. A transfer that stops short
+    // is continued from there, and a request only counts as completed once its whole response is in.
+    std::vector<uint32_t> send_offsets(config.inflight_ops, 0);
+    std::vector<uint32_t> recv_offsets(config.inflight_ops, 0);
+    // CRC32C of the part of each slot's page received so far, fed as the pieces of the response arrive.
+    std::vector<uint32_t> recv_crcs(config.inflight_ops, 0);
+    int64_t partial_transfers = 0;
+
+    const uint32_t num_connections = connections.size();
 
-    auto start_time = std::chrono::steady_clock::now();
-    auto last_report_time = start_time;
     std::chrono::time_point<std::chrono::steady_clock> now;
-    double elapsed_seconds, segment_duration;
+    double elapsed_seconds;
 
     int sqes_to_submit = 0;
 
-    while (connections.size() < config.connections_per_thread) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    cout << "Thread " << thread_id << " has " << num_connections << " connections." << endl;
+
+    if (num_connections == 0) {
+        return;
     }
 
-    cout << "Thread " << thread_id << " has " << num_connections << " connections." << endl;
+    // COALESCE_PAGES sends the requests of several slots for nearby pages as one range. A range stays open for
+    // requests until COALESCE_WINDOW_US after its first one, range ids carry the range's index like request ids
+    // carry the slot. Pages of a range may still be in flight once all the slots it served asked again, so there
+    // are twice as many ranges as slots and a request that finds none free waits for one.
+    const bool coalescing = page_protocol && config.coalesce_pages > 1;
+    const int range_bits = slot_bits + 1;
+    const uint32_t range_mask = (1u << range_bits) - 1;
+    std::vector<CoalescedRange> ranges(coalescing ? 2 * config.inflight_ops : 0);
+    std::vector<uint32_t> range_ids(ranges.size(), 0);
+    std::vector<uint32_t> free_ranges;
+    std::vector<uint32_t> open_ranges; // oldest first
+    std::deque<std::pair<uint32_t, uint32_t>> waiting_for_range; // connection and slot
+    for (int i = (int) ranges.size() - 1; i >= 0; --i) {
+        free_ranges.push_back(i);
+    }
+    const uint64_t coalesce_window_ns = (uint64_t) config.coalesce_window_us * 1000;
+    int64_t ranges_sent = 0;
+    int64_t requests_coalesced = 0;
+    int64_t pages_unrequested = 0;
+
+    auto send_range = [&](const uint32_t index) {
+        open_ranges.erase(std::find(open_ranges.begin(), open_ranges.end(), index));
+        CoalescedRange &range = ranges[index];
+        GetPagesRequest request;
+        request.request_id = ((range_ids[index] >> range_bits) + 1) << range_bits | index;
+        request.page_number = range.first_page;
+        request.page_count = range.page_count;
+        range_ids[index] = request.request_id;
+        range.pages_pending = range.page_count;
+        ++ranges_sent;
+        if (range.requests > 1) {
+            requests_coalesced += range.requests;
+        }
+        pages_unrequested += range.page_count - range.requests;
+        request.to_network_order();
+        memcpy(send_buffers + range.send_slot * request_size, &request, request_size);
+        if (!queue_request(ring, connections, range.conn, range.send_slot, send_buffers)) {
+            return false;
+        }
+        ++sqes_to_submit;
+        return true;
+    };
+
+    // Adds the request of slot to an open range its page is near enough to, or opens a range for it. The same page
+    // twice never shares a range, a full range goes out at once and so does the oldest when too many are open.
+    auto coalesce = [&](const uint32_t conn, const uint32_t slot) {
+        const uint32_t page = request_pages[slot];
+        const uint32_t reach = config.coalesce_max_gap + 1;
+        for (const uint32_t index : open_ranges) {
+            CoalescedRange &range = ranges[index];
+            const uint32_t last = range.first_page + range.page_count - 1;
+            if (page + reach < range.first_page || page > last + reach) {
+                continue;
+            }
+            const uint32_t first = std::min(range.first_page, page);
+            const uint32_t count = std::max(last, page) - first + 1;
+            if (count > (uint32_t) config.coalesce_pages ||
+                (page >= range.first_page && page <= last && range.slots[page - range.first_page] >= 0)) {
+                continue;
+            }
+            range.slots.insert(range.slots.begin(), range.first_page - first, -1);
+            range.slots.resize(count, -1);
+            range.slots[page - first] = slot;
+            range.first_page = first;
+            range.page_count = count;
+            ++range.requests;
+            return count < (uint32_t) config.coalesce_pages || send_range(index);
+        }
+        if (free_ranges.empty()) {
+            waiting_for_range.emplace_back(conn, slot);
+            return true;
+        }
+        if (open_ranges.size() == MAX_OPEN_RANGES && !send_range(open_ranges.front())) {
+            return false;
+        }
+        const uint32_t index = free_ranges.back();
+        free_ranges.pop_back();
+        CoalescedRange &range = ranges[index];
+        range.conn = conn;
+        range.send_slot = slot;
+        range.first_page = page;
+        range.page_count = 1;
+        range.requests = 1;
+        range.opened = monotonic_ns();
+        range.slots.assign(1, slot);
+        open_ranges.push_back(index);
+        return true;
+    };
+
+    // Sends the ranges whose window has closed by now_ns.
+    auto send_due_ranges = [&](const uint64_t now_ns) {
+        while (!open_ranges.empty() && ranges[open_ranges.front()].opened + coalesce_window_ns <= now_ns) {
+            if (!send_range(open_ranges.front())) {
+                return false;
+            }
+        }
+        return true;
+    };
 
-    for (int i = 0; i < config.inflight_ops; ++i) {
-        struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+    auto release_range = [&](const uint32_t index) {
+        free_ranges.push_back(index);
+        if (waiting_for_range.empty()) {
+            return true;
+        }
+        const auto [conn, slot] = waiting_for_range.front();
+        waiting_for_range.pop_front();
+        return coalesce(conn, slot);
+    };
+
+    // Queues the next request of slot buffer_index, with PROTOCOL=page for the next PAGES_PER_REQUEST pages in
+    // sequence. A range never wraps around the end of the dataset.
+    auto send_request = [&](const uint32_t conn, const uint32_t buffer_index) {
+        if (coalescing) {
+            if (next_page >= (uint32_t) config.page_count) {
+                next_page = 0;
+            }
+            request_pages[buffer_index] = next_page++;
+            request_counts[buffer_index] = 1;
+            pages_pending[buffer_index] = 1;
+            return coalesce(conn, buffer_index);
+        }
+        if (page_protocol) {
+            const uint32_t count = config.pages_per_request;
+            if (next_page + count > (uint32_t) config.page_count) {
+                next_page = 0;
+            }
+            GetPagesRequest request;
+            request.request_id = ((request_ids[buffer_index] >> slot_bits) + 1) << slot_bits | buffer_index;
+            request.page_number = next_page;
+            request.page_count = count;
+            next_page += count;
+            request_ids[buffer_index] = request.request_id;
+            request_pages[buffer_index] = request.page_number;
+            request_counts[buffer_index] = count;
+            pages_pending[buffer_index] = count;
+            request.to_network_order();
+            // A GetPageRequest is the leading part of a GetPagesRequest.
+            memcpy(send_buffers + buffer_index * request_size, &request, request_size);
+        }
+        return queue_request(ring, connections, conn, buffer_index, send_buffers);
+    };
+
+    // Sends the request intended at the given time on a free slot, slot i belongs to connection i % n.
+    auto dispatch = [&](const uint64_t intended) {
+        const uint32_t buffer_index = free_slots.back();
+        free_slots.pop_back();
+        send_times[buffer_index] = intended;
+        if (!send_request(buffer_index % num_connections, buffer_index)) {
+            return false;
+        }
+        ++sqes_to_submit;
+        ++inflight;
+        return true;
+    };
+
+    // Sleeps on a ring timeout until the next intended send time.
+    auto arm_timer = [&]() {
+        struct io_uring_sqe *sqe = get_sqe(ring);
         if (!sqe) {
             std::cerr << "io_uring_get_sqe failed" << std::endl;
-            break;
+            return false;
         }
+        timer_ts.tv_sec = next_arrival / 1000000000ULL;
+        timer_ts.tv_nsec = next_arrival % 1000000000ULL;
+        io_uring_prep_timeout(sqe, &timer_ts, 0, IORING_TIMEOUT_ABS);
+        sqe->user_data = pack_user_data({0, OP_TIMER, 0, 0});
+        ++sqes_to_submit;
+        return true;
+    };
+
+    // Issues every request whose intended time has passed, those that find no free slot wait in the backlog. At a
+    // rate beyond what the thread can even count, one call releases at most MAX_RELEASED arrivals and the timer,
+    // already due, brings it back after the completions; the backlog keeps at most MAX_BACKLOG and drops the rest.
+    constexpr int MAX_RELEASED = 4096;
+    constexpr size_t MAX_BACKLOG = 1 << 20;
+    auto release_arrivals = [&]() {
+        const uint64_t now_ns = monotonic_ns();
+        for (int released = 0; released < MAX_RELEASED && next_arrival <= now_ns && next_arrival < arrivals_end;
+             ++released) {
+            if (free_slots.empty()) {
+                if (backlog.size() < MAX_BACKLOG) {
+                    backlog.push_back(next_arrival);
+                } else {
+                    ++requests_dropped;
+                }
+            } else if (!dispatch(next_arrival)) {
+                return false;
+            }
+            next_arrival = arrivals.next();
+        }
+        return next_arrival >= arrivals_end || arm_timer();
+    };
+
+    if (open_loop) {
+        for (int i = config.inflight_ops - 1; i >= 0; --i) {
+            free_slots.push_back(i);
+        }
+        if (!arm_timer()) {
+            return;
+        }
+    } else if (config.load_mode == "open") {
+        std::cerr << "LOAD_MODE=open needs full-duplex mode, running closed-loop." << std::endl;
+    }
+
+    // With PROTOCOL=page each connection that owns a slot keeps one receive armed, in the buffer of its index,
+    // and every response that arrives on it is matched to its request by id.
+    for (uint32_t conn = 0; page_protocol && conn < num_connections && conn < (uint32_t)config.inflight_ops; ++conn) {
+        if (!queue_response(ring, connections, conn, conn, recv_buffers)) {
+            return;
+        }
+        ++sqes_to_submit;
+    }
+
+    for (int i = 0; i < config.inflight_ops && !open_loop; ++i) {
         int buffer_index = i % config.inflight_ops;
 
-        int conn_fd = connections[i % num_connections];
+        const uint32_t conn = i % num_connections;
 
-        if (config.half_duplex_mode) {
-            io_uring_prep_read_fixed(sqe, conn_fd, recv_buffers + buffer_index * config.page_size, config.page_size, 0,
-                                     config.inflight_ops + buffer_index);
-            UserData data;
-            data.buffer_idx = buffer_index;
-            data.is_send = false;
-            data.fd = conn_fd;
-            sqe->user_data = pack_user_data(data);
-        } else {
-            io_uring_prep_send(sqe, conn_fd, send_buffers + buffer_index * 4, 4, 0);
-            UserData data;
-            data.buffer_idx = buffer_index;
-            data.is_send = true;
-            data.fd = conn_fd;
-            sqe->user_data = pack_user_data(data);
+        send_times[buffer_index] = monotonic_ns();
+        const bool queued = config.half_duplex_mode
+                                ? queue_response(ring, connections, conn, buffer_index, recv_buffers)
+                                : send_request(conn, buffer_index);
+        if (!queued) {
+            break;
         }
         ++sqes_to_submit;
         ++inflight;
@@ -211,104 +484,186 @@ void client_handle_connection(const int thread_id, ThreadResult &result, struct
         sqes_to_submit = 0;
     }
 
-    while (true) {
-        now = std::chrono::steady_clock::now();
-        elapsed_seconds = std::chrono::duration<double>(now - client_start_time).count();
-        if (elapsed_seconds >= config.run_duration_seconds && inflight == 0) {
-            cout << "Time limit reached. Client thread " << thread_id << " exiting loop." << endl;
-            break;
-        }
-
-        struct io_uring_cqe *cqe;
-        ret = io_uring_wait_cqe(&ring, &cqe);
-        if (ret < 0) {
-            std::cerr << "io_uring_wait_cqe: " << strerror(-ret) << std::endl;
-            break;
-        }
-
+    // Handles one CQE, returns false if the thread has to stop.
+    auto process_cqe = [&](struct io_uring_cqe *cqe) {
         UserData data = unpack_user_data(cqe->user_data);
         uint32_t buffer_index = data.buffer_idx;
-        bool is_send = data.is_send;
-        int conn_fd = data.fd;
+        bool is_send = data.op == OP_SEND;
+        uint32_t conn = data.conn;
 
-        int conn_index = fd_to_conn_index[conn_fd];
+        if (data.op == OP_TIMER) {
+            return release_arrivals();
+        }
+
+        ConnectionSlot &slot = connections[conn];
 
         if (cqe->res < 0) {
             if (cqe->res == -EAGAIN) {
-                struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
-                if (!sqe) {
-                    std::cerr << "io_uring_get_sqe failed" << std::endl;
-                    break;
-                }
-                if (is_send) {
-                    io_uring_prep_send(sqe, conn_fd, send_buffers + buffer_index * 4, 4, 0);
-                    sqe->user_data = pack_user_data(data);
-                } else {
-                    if (config.half_duplex_mode) {
-                        io_uring_prep_read_fixed(sqe, conn_fd, recv_buffers + buffer_index * config.page_size,
-                                                 config.page_size, 0, config.inflight_ops + buffer_index);
-                    } else {
-                        io_uring_prep_recv(sqe, conn_fd, recv_buffers + buffer_index * config.page_size,
-                                           config.page_size, 0);
-                    }
-                    sqe->user_data = pack_user_data(data);
+                const bool queued = is_send
+                                        ? queue_request(ring, connections, conn, buffer_index, send_buffers,
+                                                        send_offsets[buffer_index])
+                                        : queue_response(ring, connections, conn, buffer_index, recv_buffers,
+                                                         recv_offsets[buffer_index]);
+                if (!queued) {
+                    return false;
                 }
                 ++sqes_to_submit;
             } else if (cqe->res == -ECONNRESET || cqe->res == -EPIPE) {
-                if (config.verbose) cout << "Connection closed by server on fd " << conn_fd << endl;
+                if (config.verbose) cout << "Connection closed by server on connection " << conn << endl;
                 --inflight;
-                break;
+                return false;
             } else {
                 std::cerr << "Operation error: " << strerror(-cqe->res) << std::endl;
                 --inflight;
-                break;
+                return false;
             }
         } else if (cqe->res == 0) {
-            cout << "Connection closed by server on fd " << conn_fd << endl;
+            cout << "Connection closed by server on connection " << conn << endl;
             --inflight;
-            break;
+            return false;
         } else {
             if (is_send) {
-                total_bytes_sent[conn_index] += cqe->res;
-                bytes_sent_since_last_report[conn_index] += cqe->res;
+                bump(slot.total_bytes_sent, cqe->res);
+
+                send_offsets[buffer_index] += cqe->res;
+                if (send_offsets[buffer_index] < (uint32_t) request_size) {
+                    ++partial_transfers;
+                    if (!queue_request(ring, connections, conn, buffer_index, send_buffers,
+                                       send_offsets[buffer_index])) {
+                        return false;
+                    }
+                    ++sqes_to_submit;
+                    return true;
+                }
+                send_offsets[buffer_index] = 0;
 
                 if (config.half_duplex_mode) {
                     std::cerr << "Unexpected send completion in half-duplex mode" << std::endl;
-                } else {
-                    struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
-                    if (!sqe) {
-                        std::cerr << "io_uring_get_sqe failed" << std::endl;
-                        break;
+                } else if (!page_protocol) {
+                    if (!queue_response(ring, connections, conn, buffer_index, recv_buffers)) {
+                        return false;
                     }
-                    io_uring_prep_recv(sqe, conn_fd, recv_buffers + buffer_index * config.page_size, config.page_size, 0);
-                    sqe->user_data = pack_user_data({buffer_index, false, (uint16_t)conn_fd});
                     ++sqes_to_submit;
                 }
             } else {
-                int bytes_received = cqe->res;
                 if (config.verbose)
-                    cout << "Thread " << thread_id << " received " << bytes_received << " bytes on connection " << conn_index << "." << endl;
+                    cout << "Thread " << thread_id << " received " << cqe->res << " bytes on connection " << conn << "." << endl;
 
-                total_bytes_received[conn_index] += bytes_received;
-                bytes_received_since_last_report[conn_index] += bytes_received;
+                bump(slot.total_bytes_received, cqe->res);
 
-                ++requests_completed[conn_index];
+                const uint32_t received = recv_offsets[buffer_index];
+                recv_offsets[buffer_index] += cqe->res;
+                if (page_protocol && config.page_checksums && recv_offsets[buffer_index] > (uint32_t) response_header_size) {
+                    // Checksummed while the bytes are still in cache, the header in front of the page is not.
+                    const uint32_t from = std::max(received, (uint32_t) response_header_size);
+                    recv_crcs[buffer_index] = crc32c(recv_buffers + buffer_index * response_size + from,
+                                                     recv_offsets[buffer_index] - from, recv_crcs[buffer_index]);
+                }
+                if (recv_offsets[buffer_index] < (uint32_t) response_size) {
+                    ++partial_transfers;
+                    if (!queue_response(ring, connections, conn, buffer_index, recv_buffers,
+                                        recv_offsets[buffer_index])) {
+                        return false;
+                    }
+                    ++sqes_to_submit;
+                    return true;
+                }
+                recv_offsets[buffer_index] = 0;
+                const uint32_t page_crc = recv_crcs[buffer_index];
+                recv_crcs[buffer_index] = 0;
+
+                uint32_t request_slot = buffer_index;
+                if (page_protocol) {
+                    GetPageResponseHeader header = {};
+                    memcpy(&header, recv_buffers + buffer_index * response_size, response_header_size);
+                    header.to_host_order();
+                    // The page is checked before its buffer is handed to the next receive.
+                    const char *page = recv_buffers + buffer_index * response_size + response_header_size;
+                    bool corrupt = false;
+                    if (config.page_checksums && page_crc != header.checksum) {
+                        corrupt = true;
+                        ++checksum_mismatches;
+                    }
+                    if (config.verify_pages && header.get_status() == SUCCESS) {
+                        const bool wrong = !kernels.verify(page, (size_t) header.page_number * config.page_size,
+                                                           config.page_size);
+                        ++pages_verified;
+                        pages_corrupt += wrong;
+                        corrupt |= wrong;
+                    }
+                    if (!queue_response(ring, connections, conn, buffer_index, recv_buffers)) {
+                        return false;
+                    }
+                    ++sqes_to_submit;
+
+                    bool known;
+                    if (coalescing) {
+                        const uint32_t index = header.request_id & range_mask;
+                        known = index < ranges.size() && range_ids[index] == header.request_id &&
+                                header.page_number - ranges[index].first_page < ranges[index].page_count;
+                        if (known) {
+                            const int32_t owner = ranges[index].slots[header.page_number - ranges[index].first_page];
+                            if (--ranges[index].pages_pending == 0 && !release_range(index)) {
+                                return false;
+                            }
+                            if (owner < 0) {
+                                // Fetched only to close a gap in the range, nobody waits for it.
+                                responses_failed += header.get_status() != SUCCESS || corrupt;
+                                return true;
+                            }
+                            request_slot = owner;
+                        }
+                    } else {
+                        request_slot = header.request_id & slot_mask;
+                        known = request_slot < (uint32_t) config.inflight_ops &&
+                                request_ids[request_slot] == header.request_id;
+                    }
+                    if (!known) {
+                        std::cerr << "Response to unknown request " << header.request_id << " on connection "
+                                  << conn << std::endl;
+                        ++responses_failed;
+                        return true;
+                    }
+                    if (header.get_status() != SUCCESS ||
+                        header.page_number - request_pages[request_slot] >= request_counts[request_slot] ||
+                        corrupt) {
+                        ++responses_failed;
+                    }
+                }
+
+                bump(slot.message_count, 1);
                 ++total_requests_completed;
 
-                if (elapsed_seconds < config.run_duration_seconds) {
-                    struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
-                    if (!sqe) {
-                        std::cerr << "io_uring_get_sqe failed" << std::endl;
-                        break;
+                if (page_protocol && --pages_pending[request_slot] > 0) {
+                    return true;
+                }
+
+                if (!config.half_duplex_mode) {
+                    latencies[conn].record(monotonic_ns() - send_times[request_slot]);
+                }
+
+                if (open_loop) {
+                    // The slot goes to the oldest request that is already late, or waits for the next arrival.
+                    --inflight;
+                    free_slots.push_back(request_slot);
+                    if (!backlog.empty()) {
+                        const uint64_t intended = backlog.front();
+                        backlog.pop_front();
+                        if (!dispatch(intended)) {
+                            return false;
+                        }
                     }
+                } else if (elapsed_seconds < config.run_duration_seconds) {
                     if (config.half_duplex_mode) {
-                        io_uring_prep_read_fixed(sqe, conn_fd, recv_buffers + buffer_index * config.page_size,
-                                                 config.page_size, 0, config.inflight_ops + buffer_index);
-                        sqe->user_data = pack_user_data(data);
+                        if (!queue_response(ring, connections, conn, buffer_index, recv_buffers)) {
+                            return false;
+                        }
                     } else {
-                        io_uring_prep_send(sqe, conn_fd, send_buffers + buffer_index * 4, 4, 0);
-                        sqe->user_data = pack_user_data({buffer_index, true, (uint16_t)conn_fd});
-                        ++inflight;
+                        // The slot asks again on its own connection, a coalesced range may have answered on another.
+                        send_times[request_slot] = monotonic_ns();
+                        if (!send_request(request_slot % num_connections, request_slot)) {
+                            return false;
+                        }
                     }
                     ++sqes_to_submit;
                 } else {
@@ -317,59 +672,115 @@ void client_handle_connection(const int thread_id, ThreadResult &result, struct
             }
         }
 
-        io_uring_cqe_seen(&ring, cqe);
+        return true;
+    };
 
+    while (true) {
         now = std::chrono::steady_clock::now();
-        double time_since_last_report = std::chrono::duration<double>(now - last_report_time).count();
-        if (time_since_last_report >= 1.0) {
-            segment_duration = time_since_last_report;
-
-            for (int i = 0; i < num_connections; ++i) {
-                double conn_throughput = (requests_completed[i] - requests_completed_since_last_report[i]) / segment_duration;
-
-                double data_transferred_bits =
-                    (bytes_sent_since_last_report[i] + bytes_received_since_last_report[i]) * 8;
-                double conn_gbit_per_second = data_transferred_bits / (segment_duration * 1e9);
-
-                cout << "Client thread " << thread_id << ", connection " << i << " completed "
-                     << requests_completed[i] << " requests. Throughput: " << conn_throughput
-                     << " it/s, " << conn_gbit_per_second << " Gbit/s." << endl;
-
-                Metrics m;
-                m.timestamp = std::chrono::duration<double>(now - client_start_time).count();
-                m.requests_completed = requests_completed[i];
-                m.throughput = conn_throughput;
-                m.gbit_per_second = conn_gbit_per_second;
-                result.per_second_metrics[i].push_back(m);
-
-                bytes_sent_since_last_report[i] = 0;
-                bytes_received_since_last_report[i] = 0;
-                requests_completed_since_last_report[i] = requests_completed[i];
-            }
+        elapsed_seconds = std::chrono::duration<double>(now - client_start_time).count();
+        // Once the arrival process has run out no timer is left to wake the ring, the last response ends the run.
+        const bool time_up = elapsed_seconds >= config.run_duration_seconds
+                             || (open_loop && next_arrival >= arrivals_end && backlog.empty());
+        if (time_up && inflight == 0) {
+            cout << "Time limit reached. Client thread " << thread_id << " exiting loop." << endl;
+            break;
+        }
+        if (open_loop && elapsed_seconds >= config.run_duration_seconds) {
+            // Requests that never got a free slot before the end are not sent at all, nor are arrivals a thread
+            // that fell behind has not released yet.
+            requests_dropped += backlog.size();
+            backlog.clear();
+            next_arrival = std::max(next_arrival, arrivals_end);
+        }
 
-            last_report_time = now;
+        if (coalescing && !send_due_ranges(monotonic_ns())) {
+            break;
         }
 
-        if (sqes_to_submit > 0) {
-            ret = io_uring_submit(&ring);
-            if (ret < 0) {
-                std::cerr << "io_uring_submit: " << strerror(-ret) << std::endl;
-                break;
+        // Submitting and waiting share one syscall, which is skipped while completions are still queued. A range
+        // still open wakes the ring when its window closes.
+        struct io_uring_cqe *cqe;
+        if (sqes_to_submit > 0 || io_uring_cq_ready(&ring) == 0) {
+            if (open_ranges.empty()) {
+                ret = io_uring_submit_and_wait(&ring, 1);
+            } else {
+                const uint64_t now_ns = monotonic_ns();
+                const uint64_t due = ranges[open_ranges.front()].opened + coalesce_window_ns;
+                const uint64_t wait_ns = due > now_ns ? due - now_ns : 0;
+                struct __kernel_timespec wait_ts = {};
+                wait_ts.tv_sec = wait_ns / 1000000000ULL;
+                wait_ts.tv_nsec = wait_ns % 1000000000ULL;
+                ret = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, &wait_ts, nullptr);
             }
             sqes_to_submit = 0;
+            if (ret == -EINTR || ret == -ETIME) {
+                continue;
+            } else if (ret < 0) {
+                std::cerr << "io_uring_submit_and_wait: " << strerror(-ret) << std::endl;
+                break;
+            }
         }
 
-        if (inflight == 0 && elapsed_seconds >= config.run_duration_seconds) {
+        unsigned head;
+        unsigned count = 0;
+        bool failed = false;
+        const unsigned batch = std::min<unsigned>(io_uring_cq_ready(&ring), config.cqe_batch_size);
+        io_uring_for_each_cqe(&ring, head, cqe) {
+            if (count == batch) {
+                break;
+            }
+            // Pull the next completion's connection into cache while this one is handled.
+            if (count + 1 < batch) {
+                connections.prefetch(unpack_user_data(next_cqe(ring, head)->user_data).conn);
+            }
+            if (!process_cqe(cqe)) {
+                failed = true;
+                break;
+            }
+            ++count;
+        }
+        io_uring_cq_advance(&ring, count);
+        if (failed) {
             break;
         }
+
+        if (inflight == 0 && time_up) {
+            break;
+        }
+    }
+
+    if (page_protocol) {
+        cout << "Client thread " << thread_id << " got " << responses_failed
+             << " page responses with an error status, a wrong page, corrupt content or an unknown request id."
+             << endl;
+        if (config.verify_pages) {
+            cout << "Client thread " << thread_id << " verified " << pages_verified << " pages with "
+                 << kernels.isa() << " kernels, " << pages_corrupt << " were corrupt." << endl;
+        }
+        if (coalescing) {
+            cout << "Client thread " << thread_id << " sent " << ranges_sent << " coalesced range requests, "
+                 << requests_coalesced << " requests shared a range and " << pages_unrequested
+                 << " pages were fetched only to close gaps." << endl;
+        }
+        if (config.page_checksums) {
+            cout << "Client thread " << thread_id << " found " << checksum_mismatches << " pages not matching their "
+                 << crc32c_isa() << " CRC32C." << endl;
+        }
+    }
+    cout << "Client thread " << thread_id << " continued " << partial_transfers
+         << " sends and receives that stopped short of a whole message." << endl;
+    if (open_loop) {
+        cout << "Client thread " << thread_id << " offered " << config.target_rate / config.thread_count
+             << " requests/s with " << config.arrival_process << " arrivals, " << requests_dropped
+             << " intended requests were dropped from a full backlog or still waiting for a slot at the end." << endl;
     }
 
     result.total_requests_completed = total_requests_completed;
     result.total_bytes_sent = 0;
     result.total_bytes_received = 0;
-    for (int i = 0; i < num_connections; ++i) {
-        result.total_bytes_sent += total_bytes_sent[i];
-        result.total_bytes_received += total_bytes_received[i];
+    for (uint32_t i = 0; i < num_connections; ++i) {
+        result.total_bytes_sent += connections[i].total_bytes_sent;
+        result.total_bytes_received += connections[i].total_bytes_received;
     }
 
     if (config.half_duplex_mode) {
@@ -379,7 +790,7 @@ void client_handle_connection(const int thread_id, ThreadResult &result, struct
     }
 }
 
-void client_thread(const int thread_id, ThreadResult &result) {
+void client_thread(const int thread_id, ThreadResult &result, MetricsReporter &reporter) {
     cout << "Client thread " << thread_id << " started in " << (config.half_duplex_mode ? "half-duplex" : "full-duplex")
          << " mode." << endl;
     if (!set_thread_affinity(thread_id)) {
@@ -388,7 +799,31 @@ void client_thread(const int thread_id, ThreadResult &result) {
 
     int ret;
 
-    std::vector<int> connections;
+    struct io_uring ring;
+
+    if (!setup_io_uring(ring, thread_id)) {
+        return;
+    }
+
+    // Affinity is set by now, so the node the thread runs on is the one its buffers belong on.
+    BufferArena arena(config.use_aligned_allocations ? buffer_arena_size() : 0, config.buffer_huge_pages,
+                      config.buffer_numa_bind ? BufferArena::current_node() : -1, config.alloc_pin);
+    result.buffer_placement = arena.placement();
+
+    char *send_buffers;
+    char *recv_buffers;
+
+    if (!setup_buffers(ring, send_buffers, recv_buffers, arena)) {
+        return;
+    }
+
+    // Connections take slots 0..n-1 in order, with FIXED_FILES the sockets live only in the ring's file table.
+    ConnectionTable connections(&ring, config.connections_per_thread, config.fixed_files);
+    if (!connections.register_files()) {
+        cleanup_buffers(ring, send_buffers, recv_buffers);
+        return;
+    }
+
     for (int i = 0; i < config.connections_per_thread; ++i) {
         int sock_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
         if (sock_fd < 0) {
@@ -430,67 +865,67 @@ void client_thread(const int thread_id, ThreadResult &result) {
 
         cout << "Client thread " << thread_id << " connected to server on fd " << sock_fd << "." << endl;
 
-        connections.push_back(sock_fd);
-    }
-
-    std::unordered_map<int, int> fd_to_conn_index;
-    for (int i = 0; i < connections.size(); ++i) {
-        fd_to_conn_index[connections[i]] = i;
-    }
-
-    result.per_second_metrics.resize(connections.size());
-
-    struct io_uring ring;
-
-    if (!setup_io_uring(ring)) {
-        for (int fd : connections) {
-            close(fd);
+        if (connections.add(sock_fd) < 0) {
+            close(sock_fd);
         }
-        return;
     }
 
-    char *send_buffers;
-    char *recv_buffers;
-
-    if (!setup_buffers(ring, send_buffers, recv_buffers)) {
-        for (int fd : connections) {
-            close(fd);
-        }
-        return;
-    }
+    std::vector<SharedLatencyHistogram> latencies(connections.size());
+    reporter.attach(thread_id, connections, result.per_second_metrics, &latencies);
 
-    client_handle_connection(thread_id, result, ring, send_buffers, recv_buffers, connections, fd_to_conn_index);
+    client_handle_connection(thread_id, result, ring, send_buffers, recv_buffers, connections, latencies);
 
     auto end_time = std::chrono::steady_clock::now();
     result.duration = std::chrono::duration<double>(end_time - client_start_time).count();
 
-    cleanup_buffers(ring, send_buffers, recv_buffers);
+    reporter.detach(thread_id);
 
-    for (int fd : connections) {
-        close(fd);
+    for (const auto &connection_latency : latencies) {
+        LatencyHistogram snapshot;
+        connection_latency.snapshot(snapshot);
+        result.latency.merge(snapshot);
     }
 
+    for (uint32_t i = 0; i < connections.size(); ++i) {
+        connections.remove(i);
+    }
+
+    cleanup_buffers(ring, send_buffers, recv_buffers);
+
     cout << "Client thread " << thread_id << " exiting." << endl;
 }
 
 int main() {
     config.load_from_env();
 
+    if (config.protocol == "page") {
+        request_size = config.page_range_requests ? sizeof(GetPagesRequest) : sizeof(GetPageRequest);
+        response_header_size = GetPageResponseHeader::wire_size(config.page_checksums);
+        response_size = response_header_size + config.page_size;
+    } else {
+        response_size = config.page_size;
+    }
+
     cout << "Client starting..." << endl;
 
     client_start_time = std::chrono::steady_clock::now();
 
+    MetricsReporter reporter("Client thread", "completed", "requests", config.metrics_interval_ms);
+    reporter.start();
+
     std::vector<std::thread> clients;
     std::vector<ThreadResult> thread_results(config.thread_count);
 
     for (int i = 0; i < config.thread_count; ++i) {
-        clients.emplace_back(client_thread, i, std::ref(thread_results[i]));
+        clients.emplace_back(client_thread, i, std::ref(thread_results[i]), std::ref(reporter));
     }
 
     for (auto &client: clients) {
         client.join();
     }
 
+    reporter.stop();
+
     int64_t total_requests_completed = 0;
     int64_t total_bytes_sent = 0;
     int64_t total_bytes_received = 0;
@@ -514,6 +949,17 @@ int main() {
     cout << "Aggregate Throughput: " << total_throughput << " it/s, "
          << total_gbit_per_second << " Gbit/s." << endl;
 
+    LatencyHistogram total_latency;
+    for (const auto &result: thread_results) {
+        total_latency.merge(result.latency);
+    }
+    if (total_latency.count() > 0) {
+        cout << "Request latency over " << total_latency.count() << " requests: p50 "
+             << total_latency.percentile(50) / 1e3 << " us, p90 " << total_latency.percentile(90) / 1e3
+             << " us, p99 " << total_latency.percentile(99) / 1e3 << " us, p99.9 "
+             << total_latency.percentile(99.9) / 1e3 << " us, max " << total_latency.max() / 1e3 << " us." << endl;
+    }
+
     auto now = std::chrono::system_clock::now();
     std::time_t now_time_t = std::chrono::system_clock::to_time_t(now);
     char datetime_buffer[100];
@@ -522,14 +968,16 @@ int main() {
 
     std::string metrics_filename = "report_client_" + datetime_str + ".csv";
     std::ofstream metrics_file(metrics_filename);
-    metrics_file << "timestamp,thread_id,connection_num,requests_completed,throughput,gbit_per_second\n";
+    metrics_file << "timestamp,thread_id,connection_num,requests_completed,throughput,gbit_per_second,"
+                    "p50_us,p90_us,p99_us,p999_us,max_us\n";
     for (int thread_id = 0; thread_id < thread_results.size(); ++thread_id) {
         const auto& per_second_metrics = thread_results[thread_id].per_second_metrics;
         for (int conn_index = 0; conn_index < per_second_metrics.size(); ++conn_index) {
             const auto& conn_metrics = per_second_metrics[conn_index];
             for (const auto& m : conn_metrics) {
-                metrics_file << m.timestamp << "," << thread_id << "," << conn_index << "," << m.requests_completed << ","
-                             << m.throughput << "," << m.gbit_per_second << "\n";
+                metrics_file << m.timestamp << "," << thread_id << "," << conn_index << "," << m.message_count << ","
+                             << m.throughput << "," << m.gbit_per_second << "," << m.p50_us << "," << m.p90_us
+                             << "," << m.p99_us << "," << m.p999_us << "," << m.max_us << "\n";
             }
         }
     }
@@ -538,6 +986,12 @@ int main() {
     std::string config_filename = "report_client_" + datetime_str + "_env";
     config.save_to_file(config_filename);
 
+    std::vector<BufferArena::Placement> placements;
+    for (const auto &result : thread_results) {
+        placements.push_back(result.buffer_placement);
+    }
+    BufferArena::save_placements(config_filename, placements);
+
     cout << "Client finished." << endl;
     return 0;
 }
@@ -0,0 +1,123 @@
+#include "connection_table.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+ConnectionTable::ConnectionTable(struct io_uring* ring, uint32_t capacity, bool fixed_files)
+    : ring(ring), fixed_files(fixed_files), slots(capacity < MAX_CONNECTION_SLOTS ? capacity : MAX_CONNECTION_SLOTS)
+{
+    free_slots.reserve(slots.size());
+    for (uint32_t i = slots.size(); i > 0; --i)
+    {
+        free_slots.push_back(i - 1);
+    }
+}
+
+bool ConnectionTable::register_files()
+{
+    if (!fixed_files)
+    {
+        return true;
+    }
+
+    int ret = io_uring_register_files_sparse(ring, slots.size());
+    if (ret < 0)
+    {
+        std::cerr << "io_uring_register_files_sparse: " << strerror(-ret) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int ConnectionTable::add(int fd)
+{
+    if (free_slots.empty())
+    {
+        return -1;
+    }
+    const uint32_t index = free_slots.back();
+
+    if (fixed_files)
+    {
+        int ret = io_uring_register_files_update(ring, index, &fd, 1);
+        if (ret < 0)
+        {
+            std::cerr << "io_uring_register_files_update: " << strerror(-ret) << std::endl;
+            return -1;
+        }
+        close(fd);
+        fd = -1;
+    }
+
+    free_slots.pop_back();
+    ConnectionSlot& slot = slots[index];
+    slot.fd = fd;
+    slot.active = true;
+    slot.recv_leftover = 0;
+    ++active;
+    if (index >= high_water.load(std::memory_order_relaxed))
+    {
+        high_water.store(index + 1, std::memory_order_release);
+    }
+    return (int)index;
+}
+
+bool ConnectionTable::add_direct(uint32_t index)
+{
+    if (index >= slots.size() || slots[index].active)
+    {
+        return false;
+    }
+    // The kernel picks the indices from now on, our free list must not hand them out a second time.
+    kernel_allocates = true;
+    free_slots.clear();
+
+    ConnectionSlot& slot = slots[index];
+    slot.fd = -1;
+    slot.active = true;
+    slot.recv_leftover = 0;
+    ++active;
+    if (index >= high_water.load(std::memory_order_relaxed))
+    {
+        high_water.store(index + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+void ConnectionTable::remove(uint32_t index)
+{
+    ConnectionSlot& slot = slots[index];
+    if (!slot.active)
+    {
+        return;
+    }
+
+    struct io_uring_sync_cancel_reg reg = {};
+    reg.fd = fd_of(index);
+    reg.flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL | (fixed_files ? IORING_ASYNC_CANCEL_FD_FIXED : 0);
+    reg.timeout.tv_sec = -1;
+    reg.timeout.tv_nsec = -1;
+    io_uring_register_sync_cancel(ring, &reg);
+
+    if (fixed_files)
+    {
+        int empty = -1;
+        io_uring_register_files_update(ring, index, &empty, 1);
+    }
+    if (slot.fd >= 0)
+    {
+        close(slot.fd);
+    }
+
+    slot.fd = -1;
+    slot.active = false;
+    ++slot.generation;
+    --active;
+    if (!kernel_allocates)
+    {
+        free_slots.push_back(index);
+    }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <liburing.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+enum OpType : uint8_t
+{
+    OP_RECV = 0,
+    OP_SEND = 1,
+    OP_ACCEPT = 2,
+    OP_CANCEL = 3,
+    OP_HANDOFF = 4,      // a connection posted to this ring, cqe->res is the fd
+    OP_HANDOFF_SENT = 5, // completion of our own msg_ring, conn holds the fd handed off
+    OP_TIMER = 6,        // pacing timeout of the open-loop client
+    OP_SPLICE = 7,       // header write or page splice ahead of a spliced send, only reports failures
+    OP_DISK_READ = 8,    // O_DIRECT page read ahead of a send
+};
+
+// user_data of every SQE: bits 0..23 buffer index, 24..27 op, 28..47 connection slot, 48..63 slot generation.
+struct UserData
+{
+    uint32_t buffer_idx;
+    uint8_t op;
+    uint32_t conn;
+    uint16_t generation;
+};
+
+constexpr uint32_t MAX_CONNECTION_SLOTS = 1u << 20;
+
+inline uint64_t pack_user_data(const UserData& data)
+{
+    uint64_t result = 0;
+    result |= (uint64_t)(data.buffer_idx) & 0xFFFFFFULL; // bits 0..23
+    result |= ((uint64_t)(data.op) & 0xFULL) << 24; // bits 24..27
+    result |= ((uint64_t)(data.conn) & 0xFFFFFULL) << 28; // bits 28..47
+    result |= ((uint64_t)(data.generation) & 0xFFFFULL) << 48; // bits 48..63
+    return result;
+}
+
+inline UserData unpack_user_data(uint64_t user_data)
+{
+    UserData data;
+    data.buffer_idx = (uint32_t)(user_data & 0xFFFFFFULL);
+    data.op = (uint8_t)((user_data >> 24) & 0xFULL);
+    data.conn = (uint32_t)((user_data >> 28) & 0xFFFFFULL);
+    data.generation = (uint16_t)((user_data >> 48) & 0xFFFFULL);
+    return data;
+}
+
+// Per-connection state, cache line aligned. Counters accumulate across the connections that reuse a slot.
+// Only the owning worker writes them, the metrics reporter reads them from its own thread.
+struct alignas(64) ConnectionSlot
+{
+    int fd = -1; // -1 once the socket only lives in the ring's file table
+    uint16_t generation = 0; // bumped on release, so CQEs of a previous owner no longer match
+    bool active = false;
+    int recv_leftover = 0; // bytes of a request split across two receive buffers
+    char recv_partial[16]; // and those bytes, kept until the rest of the request arrives
+    std::atomic<int64_t> message_count{0};
+    std::atomic<int64_t> total_bytes_sent{0};
+    std::atomic<int64_t> total_bytes_received{0};
+    // Page cache lookups of the connection's requests, and the loaded pages its misses pushed out.
+    std::atomic<int64_t> cache_hits{0};
+    std::atomic<int64_t> cache_misses{0};
+    std::atomic<int64_t> cache_evictions{0};
+};
+
+// Single-writer increment, a plain load and store instead of a locked read-modify-write.
+inline void bump(std::atomic<int64_t>& counter, const int64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Dense table of connection slots, indexed straight from user_data. With fixed files the slot index is also the
+// connection's index in the ring's registered file table, so SQEs target it with IOSQE_FIXED_FILE and the kernel
+// skips the fget/fput of a normal fd.
+class ConnectionTable
+{
+public:
+    ConnectionTable(struct io_uring* ring, uint32_t capacity, bool fixed_files);
+
+    // Sets up the sparse registered file table, a no-op without fixed files.
+    bool register_files();
+
+    // Takes over fd and returns its slot, or -1 if the table is full. With fixed files the fd is installed in the
+    // file table and closed, the connection then no longer counts against the process fd limit.
+    int add(int fd);
+
+    // Claims a slot the kernel already filled, e.g. by a direct accept into IORING_FILE_INDEX_ALLOC.
+    bool add_direct(uint32_t slot);
+
+    // Cancels everything still queued on the connection, closes it and frees the slot.
+    void remove(uint32_t slot);
+
+    // Returns the live connection a CQE belongs to, nullptr if its slot was released since.
+    ConnectionSlot* get(const UserData& data)
+    {
+        ConnectionSlot& slot = slots[data.conn];
+        return slot.active && slot.generation == data.generation ? &slot : nullptr;
+    }
+
+    void prefetch(uint32_t slot) const
+    {
+        if (slot < slots.size())
+        {
+            __builtin_prefetch(&slots[slot]);
+        }
+    }
+
+    ConnectionSlot& operator[](uint32_t slot) { return slots[slot]; }
+    const ConnectionSlot& operator[](uint32_t slot) const { return slots[slot]; }
+
+    uint64_t user_data(uint32_t slot, uint8_t op, uint32_t buffer_idx) const
+    {
+        return pack_user_data({buffer_idx, op, slot, slots[slot].generation});
+    }
+
+    // fd argument for an SQE on the connection, paired with flag_fixed() on the prepared SQE.
+    int fd_of(uint32_t slot) const { return fixed_files ? (int)slot : slots[slot].fd; }
+
+    void flag_fixed(struct io_uring_sqe* sqe) const
+    {
+        if (fixed_files)
+        {
+            sqe->flags |= IOSQE_FIXED_FILE;
+        }
+    }
+
+    uint32_t capacity() const { return (uint32_t)slots.size(); }
+
+    // One past the highest slot ever used.
+    uint32_t size() const { return high_water.load(std::memory_order_acquire); }
+
+    uint32_t active_count() const { return active; }
+
+    bool uses_fixed_files() const { return fixed_files; }
+
+private:
+    struct io_uring* ring;
+    bool fixed_files;
+    std::vector<ConnectionSlot> slots;
+    std::vector<uint32_t> free_slots;
+    std::atomic<uint32_t> high_water{0};
+    uint32_t active = 0;
+    bool kernel_allocates = false;
+};
@@ -0,0 +1,117 @@
+#include "crc32c.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+namespace
+{
+// Reflected Castagnoli polynomial.
+constexpr uint32_t POLYNOMIAL = 0x82F63B78;
+
+struct Implementation
+{
+    const char* name;
+    uint32_t (*update)(uint32_t crc, const uint8_t* data, size_t length);
+};
+
+uint32_t update_table(uint32_t crc, const uint8_t* data, const size_t length)
+{
+    static const auto table = []
+    {
+        struct
+        {
+            uint32_t entries[256];
+        } t;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                value = value & 1 ? (value >> 1) ^ POLYNOMIAL : value >> 1;
+            }
+            t.entries[i] = value;
+        }
+        return t;
+    }();
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) uint32_t update_sse42(uint32_t crc, const uint8_t* data, const size_t length)
+{
+    uint64_t crc64 = crc;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+    for (; i < length; ++i)
+    {
+        crc = _mm_crc32_u8(crc, data[i]);
+    }
+    return crc;
+}
+#elif defined(__aarch64__)
+__attribute__((target("+crc"))) uint32_t update_armv8(uint32_t crc, const uint8_t* data, const size_t length)
+{
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; i < length; ++i)
+    {
+        crc = __crc32cb(crc, data[i]);
+    }
+    return crc;
+}
+#endif
+
+const Implementation& implementation()
+{
+    static const Implementation chosen = []() -> Implementation
+    {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2"))
+        {
+            return {"sse4.2", update_sse42};
+        }
+#elif defined(__aarch64__)
+        if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+        {
+            return {"armv8-crc", update_armv8};
+        }
+#endif
+        return {"table", update_table};
+    }();
+    return chosen;
+}
+}
+
+uint32_t crc32c(const char* data, const size_t length, const uint32_t crc)
+{
+    return ~implementation().update(~crc, (const uint8_t*)data, length);
+}
+
+const char* crc32c_isa()
+{
+    return implementation().name;
+}
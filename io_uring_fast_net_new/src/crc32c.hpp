@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C (Castagnoli), the checksum of PAGE_CHECKSUMS responses. Computed with the CPU's crc32 instruction where it
+// has one (SSE4.2 on x86, the CRC extension on ARMv8), picked at the first call, and with a lookup table otherwise.
+// crc continues a checksum over data that arrives in pieces: crc32c(b, n, crc32c(a, m)) is the checksum of a
+// followed by b.
+uint32_t crc32c(const char* data, size_t length, uint32_t crc = 0);
+
+// Implementation crc32c uses: "sse4.2", "armv8-crc" or "table".
+const char* crc32c_isa();
@@ -0,0 +1,164 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "buffer_depot.hpp"
+
+using namespace std;
+
+// Takes and gives BufferDepot buffers from several threads at once, as the stages of a pipeline would. Every thread
+// takes bursts of buffers through its own cache, hands half of them to the next thread and gives back the rest along
+// with what the previous thread handed it. The threads start together. A buffer taken while it is still out, or lost in
+// the end, fails the run. Sized with DEPOT_THREADS, DEPOT_BUFFERS, DEPOT_MAGAZINE_SIZE and DEPOT_ROUNDS.
+
+namespace
+{
+int env_int(const char* name, const int fallback)
+{
+    const char* value = std::getenv(name);
+    return value ? std::stoi(value) : fallback;
+}
+
+struct Inbox
+{
+    std::mutex lock;
+    std::vector<uint32_t> indices;
+};
+}
+
+int main()
+{
+    const int thread_count = env_int("DEPOT_THREADS", 4);
+    const uint32_t buffer_count = env_int("DEPOT_BUFFERS", 4096);
+    const uint32_t magazine_size = env_int("DEPOT_MAGAZINE_SIZE", 32);
+    const int rounds = env_int("DEPOT_ROUNDS", 100000);
+    constexpr uint32_t BUFFER_SIZE = 64;
+
+    // One cache per thread, and one more that collects the leftovers and counts the buffers in the end.
+    BufferDepot depot(BUFFER_SIZE, buffer_count, magazine_size, thread_count + 1, "none", false);
+    if (!depot.valid())
+    {
+        cerr << "Could not create the buffer depot." << endl;
+        return 1;
+    }
+
+    std::vector<std::atomic<uint8_t>> out(buffer_count);
+    std::vector<Inbox> inboxes(thread_count);
+    std::atomic<uint64_t> double_takes{0};
+    std::atomic<uint64_t> wrong_data{0};
+    std::atomic<uint64_t> empty_takes{0};
+    std::atomic<uint64_t> trips{0};
+    std::atomic<int> started{0};
+
+    auto run = [&](const int thread_id)
+    {
+        BufferDepot::Cache cache(depot);
+        ++started;
+        while (started.load() < thread_count)
+        {
+            std::this_thread::yield();
+        }
+        std::mt19937 random(thread_id);
+        std::uniform_int_distribution<uint32_t> burst(1, 2 * magazine_size);
+        std::vector<uint32_t> taken;
+        std::vector<uint32_t> handed;
+        Inbox& next = inboxes[(thread_id + 1) % thread_count];
+        Inbox& own = inboxes[thread_id];
+        for (int round = 0; round < rounds; ++round)
+        {
+            taken.clear();
+            for (uint32_t count = burst(random); count > 0; --count)
+            {
+                const BufferDepot::Handle handle = cache.take();
+                if (!handle)
+                {
+                    ++empty_takes;
+                    break;
+                }
+                if (out[handle.index].exchange(1))
+                {
+                    ++double_takes;
+                }
+                if (handle.data != depot.buffer(handle.index))
+                {
+                    ++wrong_data;
+                }
+                handle.data[0] = (char)thread_id;
+                taken.push_back(handle.index);
+            }
+
+            {
+                // A thread that falls behind gets no more than a few magazines, or it would soon hold all buffers.
+                std::lock_guard<std::mutex> guard(next.lock);
+                for (size_t i = 0; i < taken.size(); i += 2)
+                {
+                    if (next.indices.size() < 4 * magazine_size)
+                    {
+                        next.indices.push_back(taken[i]);
+                        taken[i] = UINT32_MAX;
+                    }
+                }
+            }
+            {
+                std::lock_guard<std::mutex> guard(own.lock);
+                handed.swap(own.indices);
+            }
+            for (const uint32_t index : taken)
+            {
+                if (index != UINT32_MAX)
+                {
+                    handed.push_back(index);
+                }
+            }
+            for (const uint32_t index : handed)
+            {
+                out[index].store(0);
+                cache.give(index);
+            }
+            handed.clear();
+        }
+        trips += cache.depot_trips();
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back(run, i);
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    uint32_t counted = 0;
+    {
+        BufferDepot::Cache cache(depot);
+        for (Inbox& inbox : inboxes)
+        {
+            for (const uint32_t index : inbox.indices)
+            {
+                out[index].store(0);
+                cache.give(index);
+            }
+        }
+        std::vector<uint8_t> seen(buffer_count, 0);
+        while (const BufferDepot::Handle handle = cache.take())
+        {
+            if (seen[handle.index]++)
+            {
+                ++double_takes;
+            }
+            ++counted;
+        }
+    }
+
+    cout << thread_count << " threads took and gave " << buffer_count << " buffers in magazines of " << magazine_size
+         << " for " << rounds << " rounds each: " << trips << " depot trips, " << empty_takes << " takes found the depot"
+         << " empty, " << double_takes << " buffers taken twice, " << wrong_data << " with a wrong address, "
+         << counted << " of " << buffer_count << " buffers back in the depot." << endl;
+    return double_takes == 0 && wrong_data == 0 && counted == buffer_count ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include "latency_histogram.hpp"
+
+uint64_t LatencyHistogram::value_of(const int bucket)
+{
+    if (bucket < (int)SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    const int magnitude = (bucket - SUB_BUCKETS) / (SUB_BUCKETS / 2) + 1;
+    const uint64_t sub_bucket = (bucket - SUB_BUCKETS) % (SUB_BUCKETS / 2) + SUB_BUCKETS / 2;
+    return ((sub_bucket + 1) << magnitude) - 1;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+}
+
+void LatencyHistogram::subtract(const LatencyHistogram& earlier)
+{
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        counts[i] -= earlier.counts[i];
+    }
+    total -= earlier.total;
+}
+
+uint64_t LatencyHistogram::percentile(const double percent) const
+{
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percent / 100.0 * total + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            return value_of(i);
+        }
+    }
+    return max();
+}
+
+uint64_t LatencyHistogram::max() const
+{
+    for (int i = BUCKET_COUNT - 1; i >= 0; --i)
+    {
+        if (counts[i])
+        {
+            return value_of(i);
+        }
+    }
+    return 0;
+}
+
+void SharedLatencyHistogram::snapshot(LatencyHistogram& into) const
+{
+    into.total = 0;
+    for (int i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i)
+    {
+        into.counts[i] = counts[i].load(std::memory_order_relaxed);
+        into.total += into.counts[i];
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+inline uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Log-bucketed histogram in the style of HdrHistogram. Values below SUB_BUCKETS are counted exactly, larger ones
+// are grouped by their highest set bit and split into SUB_BUCKETS / 2 linear sub-buckets, which bounds the
+// relative error of every reported value by 2 / SUB_BUCKETS. Values are in nanoseconds, up to 2^40 (~18 min).
+class LatencyHistogram
+{
+public:
+    static constexpr int SUB_BUCKET_BITS = 7;
+    static constexpr uint64_t SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+    static constexpr int MAX_VALUE_BITS = 40;
+    static constexpr int BUCKET_COUNT = SUB_BUCKETS + (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * (SUB_BUCKETS / 2);
+
+    LatencyHistogram() : counts(BUCKET_COUNT, 0) {}
+
+    static int bucket_of(uint64_t value)
+    {
+        if (value >= (1ULL << MAX_VALUE_BITS))
+        {
+            value = (1ULL << MAX_VALUE_BITS) - 1;
+        }
+        if (value < SUB_BUCKETS)
+        {
+            return (int)value;
+        }
+        const int magnitude = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS + 1;
+        const uint64_t sub_bucket = value >> magnitude;
+        return SUB_BUCKETS + (magnitude - 1) * (SUB_BUCKETS / 2) + (int)(sub_bucket - SUB_BUCKETS / 2);
+    }
+
+    // Highest value that lands in bucket, what percentiles report.
+    static uint64_t value_of(int bucket);
+
+    void record(const uint64_t value)
+    {
+        ++counts[bucket_of(value)];
+        ++total;
+    }
+
+    void merge(const LatencyHistogram& other);
+
+    // Turns a cumulative histogram into the part recorded after earlier was taken.
+    void subtract(const LatencyHistogram& earlier);
+
+    uint64_t count() const { return total; }
+
+    // Value at percentile (0..100], 0 if nothing was recorded.
+    uint64_t percentile(double percent) const;
+
+    uint64_t max() const;
+
+private:
+    friend class SharedLatencyHistogram;
+
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+};
+
+// LatencyHistogram written by one thread and snapshotted by another, the counters are single-writer atomics.
+class SharedLatencyHistogram
+{
+public:
+    void record(const uint64_t value)
+    {
+        std::atomic<uint64_t>& bucket = counts[LatencyHistogram::bucket_of(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void snapshot(LatencyHistogram& into) const;
+
+private:
+    std::atomic<uint64_t> counts[LatencyHistogram::BUCKET_COUNT] = {};
+};
@@ -0,0 +1,165 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+MetricsReporter::MetricsReporter(std::string thread_label, std::string verb, std::string unit, int interval_ms)
+    : thread_label(std::move(thread_label)), verb(std::move(verb)), unit(std::move(unit)),
+      interval(std::max(interval_ms, 10)), start_time(std::chrono::steady_clock::now()),
+      last_print_time(start_time)
+{
+}
+
+MetricsReporter::~MetricsReporter()
+{
+    stop();
+}
+
+void MetricsReporter::start()
+{
+    start_time = std::chrono::steady_clock::now();
+    last_print_time = start_time;
+    reporter = std::thread(&MetricsReporter::run, this);
+}
+
+void MetricsReporter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    if (reporter.joinable())
+    {
+        reporter.join();
+    }
+}
+
+void MetricsReporter::attach(const int thread_id, const ConnectionTable& table,
+                             std::vector<std::vector<MetricsRow>>& rows,
+                             const std::vector<SharedLatencyHistogram>* latencies)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    sources.push_back({thread_id, &table, &rows, latencies, {}, {}, std::chrono::steady_clock::now()});
+}
+
+void MetricsReporter::detach(const int thread_id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = sources.begin(); it != sources.end(); ++it)
+    {
+        if (it->thread_id == thread_id)
+        {
+            sample(*it, std::chrono::steady_clock::now(), false);
+            sources.erase(it);
+            return;
+        }
+    }
+}
+
+void MetricsReporter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto next = std::chrono::steady_clock::now() + interval;
+    while (!stopping)
+    {
+        wakeup.wait_until(lock, next, [this] { return stopping; });
+        if (stopping)
+        {
+            break;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const bool print = now - last_print_time >= std::chrono::seconds(1);
+        for (auto& source : sources)
+        {
+            sample(source, now, print);
+        }
+        if (print)
+        {
+            last_print_time = now;
+        }
+        next += interval;
+    }
+}
+
+void MetricsReporter::sample(Source& source, const std::chrono::steady_clock::time_point now, const bool print)
+{
+    const double segment_duration = std::chrono::duration<double>(now - source.last_time).count();
+    if (segment_duration <= 0)
+    {
+        return;
+    }
+
+    const uint32_t connection_count = source.table->size();
+    if (source.rows->size() < connection_count)
+    {
+        source.rows->resize(connection_count);
+    }
+    if (source.last.size() < connection_count)
+    {
+        source.last.resize(connection_count);
+    }
+    if (source.latencies && source.last_latencies.size() < connection_count)
+    {
+        source.last_latencies.resize(connection_count);
+    }
+
+    for (uint32_t i = 0; i < connection_count; ++i)
+    {
+        const ConnectionSlot& c = (*source.table)[i];
+        Snapshot current;
+        current.message_count = c.message_count.load(std::memory_order_relaxed);
+        current.bytes = c.total_bytes_sent.load(std::memory_order_relaxed) +
+            c.total_bytes_received.load(std::memory_order_relaxed);
+        current.cache_hits = c.cache_hits.load(std::memory_order_relaxed);
+        current.cache_misses = c.cache_misses.load(std::memory_order_relaxed);
+        current.cache_evictions = c.cache_evictions.load(std::memory_order_relaxed);
+
+        Snapshot& last = source.last[i];
+        double conn_throughput = (current.message_count - last.message_count) / segment_duration;
+        double conn_gbit_per_second = (current.bytes - last.bytes) * 8 / (segment_duration * 1e9);
+
+        MetricsRow m;
+        m.timestamp = std::chrono::duration<double>(now - start_time).count();
+        m.message_count = current.message_count;
+        m.throughput = conn_throughput;
+        m.gbit_per_second = conn_gbit_per_second;
+        m.cache_hits = current.cache_hits - last.cache_hits;
+        m.cache_misses = current.cache_misses - last.cache_misses;
+        m.cache_evictions = current.cache_evictions - last.cache_evictions;
+
+        if (source.latencies)
+        {
+            // The histograms are cumulative, the interval's share is the difference to the previous sample.
+            LatencyHistogram cumulative;
+            (*source.latencies)[i].snapshot(cumulative);
+            LatencyHistogram interval_latencies = cumulative;
+            interval_latencies.subtract(source.last_latencies[i]);
+            source.last_latencies[i] = std::move(cumulative);
+
+            m.p50_us = interval_latencies.percentile(50) / 1e3;
+            m.p90_us = interval_latencies.percentile(90) / 1e3;
+            m.p99_us = interval_latencies.percentile(99) / 1e3;
+            m.p999_us = interval_latencies.percentile(99.9) / 1e3;
+            m.max_us = interval_latencies.max() / 1e3;
+        }
+
+        if (print)
+        {
+            std::cout << thread_label << " " << source.thread_id << ", connection " << i << " " << verb << " "
+                << current.message_count << " " << unit << ". Throughput: " << conn_throughput << " it/s, "
+                << conn_gbit_per_second << " Gbit/s.";
+            if (source.latencies)
+            {
+                std::cout << " p50: " << m.p50_us << " us, p99: " << m.p99_us << " us.";
+            }
+            std::cout << std::endl;
+        }
+
+        (*source.rows)[i].push_back(m);
+
+        last = current;
+    }
+    source.last_time = now;
+}
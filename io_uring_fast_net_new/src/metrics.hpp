@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "connection_table.hpp"
+#include "latency_histogram.hpp"
+
+// One CSV row: a connection over one sampling interval. The latency columns, in microseconds, stay 0 unless the
+// worker records latencies, the page cache columns count the interval's lookups and evictions.
+struct MetricsRow
+{
+    double timestamp;
+    int64_t message_count;
+    double throughput;
+    double gbit_per_second;
+    double p50_us = 0;
+    double p90_us = 0;
+    double p99_us = 0;
+    double p999_us = 0;
+    double max_us = 0;
+    int64_t cache_hits = 0;
+    int64_t cache_misses = 0;
+    int64_t cache_evictions = 0;
+};
+
+// Samples the connection counters of every worker from its own thread. Workers only bump the counters in their
+// ConnectionTable; building the Metrics rows, the console output and all clock reads for them happen here,
+// every METRICS_INTERVAL_MS. The console summary is printed at most once a second whatever the interval.
+class MetricsReporter
+{
+public:
+    // Console lines read "<thread_label> <id>, connection <i> <verb> <n> <unit>. Throughput: ...".
+    MetricsReporter(std::string thread_label, std::string verb, std::string unit, int interval_ms);
+    ~MetricsReporter();
+
+    void start();
+    void stop();
+
+    // Starts sampling a worker's connections into rows, one vector of MetricsRow per connection slot. latencies,
+    // if given, holds one histogram per connection slot.
+    void attach(int thread_id, const ConnectionTable& table, std::vector<std::vector<MetricsRow>>& rows,
+                const std::vector<SharedLatencyHistogram>* latencies = nullptr);
+
+    // Takes a last sample of the worker's connections and stops reading them, call before the table goes away.
+    void detach(int thread_id);
+
+private:
+    struct Snapshot
+    {
+        int64_t message_count = 0;
+        int64_t bytes = 0;
+        int64_t cache_hits = 0;
+        int64_t cache_misses = 0;
+        int64_t cache_evictions = 0;
+    };
+
+    struct Source
+    {
+        int thread_id;
+        const ConnectionTable* table;
+        std::vector<std::vector<MetricsRow>>* rows;
+        const std::vector<SharedLatencyHistogram>* latencies;
+        std::vector<Snapshot> last;
+        std::vector<LatencyHistogram> last_latencies;
+        std::chrono::steady_clock::time_point last_time;
+    };
+
+    void run();
+    void sample(Source& source, std::chrono::steady_clock::time_point now, bool print);
+
+    std::string thread_label;
+    std::string verb;
+    std::string unit;
+    std::chrono::milliseconds interval;
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point last_print_time;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+    std::vector<Source> sources;
+    std::thread reporter;
+};
@@ -0,0 +1,120 @@
+#include "page_cache.hpp"
+
+#include <sys/mman.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include "static_config.hpp"
+
+PageCache::PageCache(uint32_t frame_count, const uint32_t page_count, const uint32_t page_size,
+                     const uint32_t header_room)
+    : header_room(header_room), frame_size((size_t)header_room + page_size), page_frames(page_count, NO_FRAME)
+{
+    constexpr size_t REGISTERED_BUFFER_LIMIT = 1UL << 30;
+    if (frame_count > REGISTERED_BUFFER_LIMIT / frame_size)
+    {
+        frame_count = REGISTERED_BUFFER_LIMIT / frame_size;
+        std::cerr << "PAGE_CACHE_PAGES exceeds one registered buffer, caching " << frame_count << " pages."
+                  << std::endl;
+    }
+    if (frame_count == 0)
+    {
+        return;
+    }
+
+    const size_t size = (size_t)frame_count * frame_size;
+    if (posix_memalign((void**)&arena, 4096, size) != 0)
+    {
+        perror("posix_memalign page cache");
+        arena = nullptr;
+        return;
+    }
+    if (config.alloc_pin)
+    {
+        locked = mlock(arena, size) == 0;
+        if (!locked)
+        {
+            perror("mlock page cache");
+        }
+    }
+    frames.resize(frame_count);
+}
+
+PageCache::~PageCache()
+{
+    if (locked)
+    {
+        munlock(arena, frames.size() * frame_size);
+    }
+    free(arena);
+}
+
+int PageCache::lookup(const uint32_t page_number)
+{
+    const uint32_t index = page_frames[page_number];
+    if (index == NO_FRAME || frames[index].state != LOADED)
+    {
+        return -1;
+    }
+    frames[index].referenced = true;
+    return (int)index;
+}
+
+int PageCache::admit(const uint32_t page_number, bool& evicted)
+{
+    evicted = false;
+    if (page_frames[page_number] != NO_FRAME)
+    {
+        return -1;
+    }
+
+    // One sweep clears every reference bit, a second one without a victim means all frames are pinned.
+    const uint32_t count = (uint32_t)frames.size();
+    for (uint32_t step = 0; step < count * 2; ++step)
+    {
+        const uint32_t index = hand;
+        Frame& frame = frames[index];
+        hand = hand + 1 == count ? 0 : hand + 1;
+
+        if (frame.pins > 0)
+        {
+            continue;
+        }
+        if (frame.referenced)
+        {
+            frame.referenced = false;
+            continue;
+        }
+
+        if (frame.state != EMPTY)
+        {
+            evicted = frame.state == LOADED;
+            page_frames[frame.page_number] = NO_FRAME;
+        }
+        frame.page_number = page_number;
+        frame.state = LOADING;
+        frame.pins = 1;
+        page_frames[page_number] = index;
+        return (int)index;
+    }
+    return -1;
+}
+
+void PageCache::finish_load(const int index, const bool ok)
+{
+    Frame& frame = frames[index];
+    if (frame.state != LOADING)
+    {
+        return;
+    }
+    if (ok)
+    {
+        frame.state = LOADED;
+        return;
+    }
+    page_frames[frame.page_number] = NO_FRAME;
+    frame.state = EMPTY;
+    frame.referenced = false;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One worker's share of the hot pages of a PAGE_SEND_MODE=direct store, so each worker is a shard of its own and
+// nothing is locked. The frames live in one aligned arena the worker registers with its rings as a single fixed
+// buffer, a page is read into its frame with read_fixed and a hit is sent from there by buffer index.
+//
+// Each frame is header_room bytes followed by the page, the tail of the room takes the response header of the
+// one send that may use the frame as its buffer. Frames are replaced with CLOCK: a hit sets the frame's reference
+// bit, and the hand clears reference bits until it finds a frame that is neither referenced nor pinned by a send
+// or read still in flight.
+class PageCache
+{
+public:
+    // frame_count is capped so that the arena stays within the kernel's 1 GiB limit of one registered buffer.
+    PageCache(uint32_t frame_count, uint32_t page_count, uint32_t page_size, uint32_t header_room);
+    ~PageCache();
+
+    PageCache(const PageCache&) = delete;
+    PageCache& operator=(const PageCache&) = delete;
+
+    bool valid() const { return arena != nullptr; }
+
+    // Returns the frame holding page_number and marks it as used, -1 if the page is not loaded.
+    int lookup(uint32_t page_number);
+
+    // Takes a frame for page_number after a failed lookup and pins it, the caller then reads the page into it
+    // and reports the outcome with finish_load. Returns -1 if the page is already being loaded or every frame is
+    // pinned, the page is then read without the cache. evicted tells whether a loaded page had to make room.
+    int admit(uint32_t page_number, bool& evicted);
+
+    // Completes the read started by admit, a failed one gives the frame up.
+    void finish_load(int frame, bool ok);
+
+    bool loading(int frame) const { return frames[frame].state == LOADING; }
+
+    void pin(int frame) { ++frames[frame].pins; }
+    void unpin(int frame) { --frames[frame].pins; }
+    // Sends and reads holding the frame. Only a send that pinned the frame while nothing else did may put its
+    // header into the frame's room.
+    uint32_t pins(int frame) const { return frames[frame].pins; }
+
+    // Start of the frame's header room, and the page right behind it.
+    char* frame(int frame) const { return arena + (size_t)frame * frame_size; }
+    char* page(int frame) const { return this->frame(frame) + header_room; }
+
+    // The arena as it is registered, one iovec.
+    struct iovec region() const { return {arena, (size_t)frames.size() * frame_size}; }
+
+    uint32_t frame_count() const { return (uint32_t)frames.size(); }
+
+private:
+    enum State : uint8_t
+    {
+        EMPTY,
+        LOADING,
+        LOADED,
+    };
+
+    struct Frame
+    {
+        uint32_t page_number = 0;
+        uint32_t pins = 0;
+        State state = EMPTY;
+        bool referenced = false;
+    };
+
+    static constexpr uint32_t NO_FRAME = UINT32_MAX;
+
+    uint32_t header_room;
+    size_t frame_size;
+    char* arena = nullptr;
+    bool locked = false;
+    std::vector<Frame> frames;
+    std::vector<uint32_t> page_frames; // dense, indexed by page number
+    uint32_t hand = 0;
+};
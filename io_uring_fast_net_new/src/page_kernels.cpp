@@ -0,0 +1,207 @@
+#include "page_kernels.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Every kernel walks the table with offset, the position in the period of the byte it is at. A vector of width
+// bytes moves it on by width % period, the one subtraction that may follow replaces a division per vector.
+namespace
+{
+constexpr size_t WIDEST_VECTOR = 32;
+
+size_t advance(size_t offset, const size_t step, const size_t period)
+{
+    offset += step;
+    return offset >= period ? offset - period : offset;
+}
+
+void fill_tail(const uint8_t* table, const size_t period, uint8_t* target, size_t offset, const size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        target[i] = table[offset];
+        offset = advance(offset, 1, period);
+    }
+}
+
+bool verify_tail(const uint8_t* table, const size_t period, const uint8_t* data, size_t offset, const size_t length)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        diff |= data[i] ^ table[offset];
+        offset = advance(offset, 1, period);
+    }
+    return diff == 0;
+}
+
+void fill_scalar(const uint8_t* table, const size_t period, uint8_t* target, size_t offset, const size_t length)
+{
+    const size_t step = sizeof(uint64_t) % period;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+    {
+        memcpy(target + i, table + offset, sizeof(uint64_t));
+        offset = advance(offset, step, period);
+    }
+    fill_tail(table, period, target + i, offset, length - i);
+}
+
+bool verify_scalar(const uint8_t* table, const size_t period, const uint8_t* data, size_t offset, const size_t length)
+{
+    const size_t step = sizeof(uint64_t) % period;
+    uint64_t diff = 0;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+    {
+        uint64_t got;
+        uint64_t expected;
+        memcpy(&got, data + i, sizeof(got));
+        memcpy(&expected, table + offset, sizeof(expected));
+        diff |= got ^ expected;
+        offset = advance(offset, step, period);
+    }
+    return diff == 0 && verify_tail(table, period, data + i, offset, length - i);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) void fill_avx2(const uint8_t* table, const size_t period, uint8_t* target,
+                                               size_t offset, const size_t length)
+{
+    const size_t step = sizeof(__m256i) % period;
+    size_t i = 0;
+    for (; i + sizeof(__m256i) <= length; i += sizeof(__m256i))
+    {
+        _mm256_storeu_si256((__m256i*)(target + i), _mm256_loadu_si256((const __m256i*)(table + offset)));
+        offset = advance(offset, step, period);
+    }
+    fill_tail(table, period, target + i, offset, length - i);
+}
+
+__attribute__((target("avx2"))) bool verify_avx2(const uint8_t* table, const size_t period, const uint8_t* data,
+                                                 size_t offset, const size_t length)
+{
+    const size_t step = sizeof(__m256i) % period;
+    __m256i diff = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + sizeof(__m256i) <= length; i += sizeof(__m256i))
+    {
+        const __m256i got = _mm256_loadu_si256((const __m256i*)(data + i));
+        const __m256i expected = _mm256_loadu_si256((const __m256i*)(table + offset));
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(got, expected));
+        offset = advance(offset, step, period);
+    }
+    return _mm256_testz_si256(diff, diff) && verify_tail(table, period, data + i, offset, length - i);
+}
+
+__attribute__((target("sse4.2"))) void fill_sse42(const uint8_t* table, const size_t period, uint8_t* target,
+                                                  size_t offset, const size_t length)
+{
+    const size_t step = sizeof(__m128i) % period;
+    size_t i = 0;
+    for (; i + sizeof(__m128i) <= length; i += sizeof(__m128i))
+    {
+        _mm_storeu_si128((__m128i*)(target + i), _mm_loadu_si128((const __m128i*)(table + offset)));
+        offset = advance(offset, step, period);
+    }
+    fill_tail(table, period, target + i, offset, length - i);
+}
+
+__attribute__((target("sse4.2"))) bool verify_sse42(const uint8_t* table, const size_t period, const uint8_t* data,
+                                                    size_t offset, const size_t length)
+{
+    const size_t step = sizeof(__m128i) % period;
+    __m128i diff = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + sizeof(__m128i) <= length; i += sizeof(__m128i))
+    {
+        const __m128i got = _mm_loadu_si128((const __m128i*)(data + i));
+        const __m128i expected = _mm_loadu_si128((const __m128i*)(table + offset));
+        diff = _mm_or_si128(diff, _mm_xor_si128(got, expected));
+        offset = advance(offset, step, period);
+    }
+    return _mm_testz_si128(diff, diff) && verify_tail(table, period, data + i, offset, length - i);
+}
+#elif defined(__aarch64__)
+void fill_neon(const uint8_t* table, const size_t period, uint8_t* target, size_t offset, const size_t length)
+{
+    const size_t step = sizeof(uint8x16_t) % period;
+    size_t i = 0;
+    for (; i + sizeof(uint8x16_t) <= length; i += sizeof(uint8x16_t))
+    {
+        vst1q_u8(target + i, vld1q_u8(table + offset));
+        offset = advance(offset, step, period);
+    }
+    fill_tail(table, period, target + i, offset, length - i);
+}
+
+bool verify_neon(const uint8_t* table, const size_t period, const uint8_t* data, size_t offset, const size_t length)
+{
+    const size_t step = sizeof(uint8x16_t) % period;
+    uint8x16_t diff = vdupq_n_u8(0);
+    size_t i = 0;
+    for (; i + sizeof(uint8x16_t) <= length; i += sizeof(uint8x16_t))
+    {
+        diff = vorrq_u8(diff, veorq_u8(vld1q_u8(data + i), vld1q_u8(table + offset)));
+        offset = advance(offset, step, period);
+    }
+    return vmaxvq_u8(diff) == 0 && verify_tail(table, period, data + i, offset, length - i);
+}
+#endif
+}
+
+PageKernels::PageKernels(const uint8_t* pattern, const size_t period)
+    : table(period + WIDEST_VECTOR), period(period), kernels(select())
+{
+    for (size_t i = 0; i < table.size(); ++i)
+    {
+        table[i] = pattern[i % period];
+    }
+}
+
+PageKernels PageKernels::pseudo_random(const uint32_t seed)
+{
+    uint8_t pattern[256];
+    for (size_t i = 0; i < sizeof(pattern); ++i)
+    {
+        pattern[i] = (uint8_t)((i * 2654435761u + seed) % 256);
+    }
+    return PageKernels(pattern, sizeof(pattern));
+}
+
+void PageKernels::fill(char* target, const size_t first_byte, const size_t length) const
+{
+    kernels->fill(table.data(), period, (uint8_t*)target, first_byte % period, length);
+}
+
+bool PageKernels::verify(const char* data, const size_t first_byte, const size_t length) const
+{
+    return kernels->verify(table.data(), period, (const uint8_t*)data, first_byte % period, length);
+}
+
+const PageKernels::Kernels* PageKernels::select()
+{
+    static const Kernels scalar = {"scalar", fill_scalar, verify_scalar};
+#if defined(__x86_64__) || defined(__i386__)
+    static const Kernels avx2 = {"avx2", fill_avx2, verify_avx2};
+    static const Kernels sse42 = {"sse4.2", fill_sse42, verify_sse42};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return &avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return &sse42;
+    }
+#elif defined(__aarch64__)
+    static const Kernels neon = {"neon", fill_neon, verify_neon};
+    return &neon;
+#endif
+    return &scalar;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fill and verify kernels for page content that repeats with a short period, as every generated dataset does:
+// PageStore's pseudo-random bytes (i * 2654435761 + seed) % 256 repeat every 256 bytes, fast_net's alphabetical
+// strategy every 26. One period is laid out in a table padded by a vector, so whatever byte a page starts at, each
+// vector of expected content is a single unaligned load from the table. The widest of AVX2, SSE4.2 and NEON the
+// CPU has is picked once at construction, a scalar loop over 8 byte words otherwise.
+class PageKernels
+{
+public:
+    // pattern points at one period of the content, period bytes long.
+    PageKernels(const uint8_t* pattern, size_t period);
+
+    // PageStore's generated content.
+    static PageKernels pseudo_random(uint32_t seed);
+
+    // Writes length bytes of content starting at byte first_byte of the pattern.
+    void fill(char* target, size_t first_byte, size_t length) const;
+
+    // Whether length bytes at data are the pattern's content from byte first_byte on.
+    bool verify(const char* data, size_t first_byte, size_t length) const;
+
+    // Instruction set of the kernels in use: "avx2", "sse4.2", "neon" or "scalar".
+    const char* isa() const { return kernels->name; }
+
+private:
+    struct Kernels
+    {
+        const char* name;
+        void (*fill)(const uint8_t* table, size_t period, uint8_t* target, size_t offset, size_t length);
+        bool (*verify)(const uint8_t* table, size_t period, const uint8_t* data, size_t offset, size_t length);
+    };
+
+    static const Kernels* select();
+
+    std::vector<uint8_t> table; // one period, then as much of the next one as the widest vector reads past it
+    size_t period;
+    const Kernels* kernels;
+};
@@ -0,0 +1,105 @@
+#include "page_protocol.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Every field of both request types is a 32-bit word in network order, so a run of requests is decoded as a run
+// of words whatever the type, with a byte shuffle per vector.
+namespace
+{
+void swap_words_scalar(const char* data, char* target, const size_t words)
+{
+    for (size_t i = 0; i < words; ++i)
+    {
+        uint32_t word;
+        memcpy(&word, data + i * sizeof(word), sizeof(word));
+        word = ntohl(word);
+        memcpy(target + i * sizeof(word), &word, sizeof(word));
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) void swap_words_avx2(const char* data, char* target, const size_t words)
+{
+    const __m256i reverse = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                             3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 8 <= words; i += 8)
+    {
+        const __m256i swapped = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(data + i * 4)), reverse);
+        _mm256_storeu_si256((__m256i*)(target + i * 4), swapped);
+    }
+    swap_words_scalar(data + i * 4, target + i * 4, words - i);
+}
+
+__attribute__((target("ssse3"))) void swap_words_ssse3(const char* data, char* target, const size_t words)
+{
+    const __m128i reverse = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4)
+    {
+        const __m128i swapped = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 4)), reverse);
+        _mm_storeu_si128((__m128i*)(target + i * 4), swapped);
+    }
+    swap_words_scalar(data + i * 4, target + i * 4, words - i);
+}
+#elif defined(__aarch64__)
+void swap_words_neon(const char* data, char* target, const size_t words)
+{
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4)
+    {
+        vst1q_u8((uint8_t*)target + i * 4, vrev32q_u8(vld1q_u8((const uint8_t*)data + i * 4)));
+    }
+    swap_words_scalar(data + i * 4, target + i * 4, words - i);
+}
+#endif
+
+using SwapWords = void (*)(const char* data, char* target, size_t words);
+
+SwapWords select_swap_words()
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return swap_words_avx2;
+    }
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        return swap_words_ssse3;
+    }
+#elif defined(__aarch64__)
+    return swap_words_neon;
+#endif
+    return swap_words_scalar;
+}
+}
+
+void decode_requests(const char* data, const size_t count, const bool ranges, GetPagesRequest* requests)
+{
+    static const SwapWords swap_words = select_swap_words();
+
+    char* target = (char*)requests;
+    if (ranges)
+    {
+        swap_words(data, target, count * 3);
+        return;
+    }
+
+    // The two words of every GetPageRequest are swapped into the front of the array, then spread out back to
+    // front: request i lands on words 3i to 3i + 2 and only overwrites words of requests behind it.
+    swap_words(data, target, count * 2);
+    for (size_t i = count; i > 0; --i)
+    {
+        uint32_t words[3];
+        memcpy(words, target + (i - 1) * 8, 8);
+        words[2] = 1;
+        memcpy(target + (i - 1) * sizeof(GetPagesRequest), words, sizeof(words));
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <arpa/inet.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Wire format of PROTOCOL=page, the same messages fast_net's servers speak (fast_net/src/models/get_page.hpp).
+// A request names one page, the response is a header followed by page_size bytes of page content. Responses of a
+// connection may come back in any order, the client matches them to its requests by request_id.
+enum GetPageStatus : uint32_t
+{
+    SUCCESS = 200,
+    INVALID_PAGE_NUMBER = 400,
+};
+
+#pragma pack(push, 1)
+struct GetPageRequest
+{
+    uint32_t request_id;
+    uint32_t page_number;
+
+    void to_network_order()
+    {
+        request_id = htonl(request_id);
+        page_number = htonl(page_number);
+    }
+
+    void to_host_order()
+    {
+        request_id = ntohl(request_id);
+        page_number = ntohl(page_number);
+    }
+};
+
+// With PAGE_RANGE_REQUESTS, which server and client have to agree on, every request is a GetPagesRequest for
+// page_count pages from page_number on, a single page being a range of one. The server answers it with one
+// response per page, all with the request's id, so on the wire a range looks like page_count single responses.
+// Pages the store does not have get INVALID_PAGE_NUMBER responses like single requests for them. A range of
+// zero pages is answered with one INVALID_PAGE_NUMBER response for page_number, and a range reaching past page
+// UINT32_MAX only up to that page.
+struct GetPagesRequest
+{
+    uint32_t request_id;
+    uint32_t page_number;
+    uint32_t page_count;
+
+    void to_network_order()
+    {
+        request_id = htonl(request_id);
+        page_number = htonl(page_number);
+        page_count = htonl(page_count);
+    }
+};
+
+// With PAGE_CHECKSUMS, which server and client have to agree on, the header carries the CRC32C of the page that
+// follows it. Without, checksum is not on the wire and the header is the 12 bytes fast_net's servers send.
+struct GetPageResponseHeader
+{
+    uint32_t request_id;
+    uint32_t status;
+    uint32_t page_number;
+    uint32_t checksum;
+
+    void to_network_order()
+    {
+        request_id = htonl(request_id);
+        status = htonl(status);
+        page_number = htonl(page_number);
+        checksum = htonl(checksum);
+    }
+
+    void to_host_order()
+    {
+        request_id = ntohl(request_id);
+        status = ntohl(status);
+        page_number = ntohl(page_number);
+        checksum = ntohl(checksum);
+    }
+
+    GetPageStatus get_status() const { return static_cast<GetPageStatus>(status); }
+
+    // Bytes of the header on the wire, the leading part of the struct.
+    static size_t wire_size(const bool checksums)
+    {
+        return checksums ? sizeof(GetPageResponseHeader) : offsetof(GetPageResponseHeader, checksum);
+    }
+};
+#pragma pack(pop)
+
+// Decodes count requests as they came off the wire at data, GetPagesRequests if ranges is set and GetPageRequests,
+// read as ranges of one page, otherwise. All their fields are byte-swapped in one vectorised pass.
+void decode_requests(const char* data, size_t count, bool ranges, GetPagesRequest* requests);
+
+// Content of the pages of an INVALID_PAGE_NUMBER response, which are still page_size long to keep framing fixed.
+constexpr uint8_t INVALID_PAGE_FILL = 0xFA;
@@ -0,0 +1,225 @@
+#include "page_store.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "crc32c.hpp"
+#include "page_kernels.hpp"
+#include "static_config.hpp"
+
+PageStore::PageStore(const uint32_t page_count, const uint32_t page_size, const std::string& path,
+                     const std::string& huge_pages, const bool populate, const bool direct)
+    : pages(page_count), page_size(page_size), size((size_t)page_count * page_size), direct(direct)
+{
+    if (path.empty())
+    {
+        if (size == 0 || !map(MAP_PRIVATE | MAP_ANONYMOUS, huge_pages, populate))
+        {
+            return;
+        }
+        generate(data, 0, size);
+        if (config.alloc_pin)
+        {
+            locked = mlock(data, size) == 0;
+            if (!locked)
+            {
+                perror("mlock page store");
+            }
+        }
+        std::cout << "Page store: " << pages << " generated pages of " << page_size << " bytes." << std::endl;
+        return;
+    }
+
+    if (access(path.c_str(), F_OK) != 0 && !create_file(path))
+    {
+        return;
+    }
+
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | (direct ? O_DIRECT : 0));
+    if (fd < 0)
+    {
+        perror("open page file");
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        perror("fstat page file");
+        return;
+    }
+
+    // The file decides how many pages there are, a trailing partial page is not served.
+    pages = st.st_size / page_size;
+    size = (size_t)pages * page_size;
+    if (pages == 0)
+    {
+        std::cerr << "Page file " << path << " holds no complete page of " << page_size << " bytes." << std::endl;
+        return;
+    }
+    if (direct)
+    {
+        std::cout << "Page store: " << pages << " pages of " << page_size << " bytes read from " << path
+                  << " with O_DIRECT." << std::endl;
+        return;
+    }
+    if (!map(MAP_SHARED, huge_pages, populate))
+    {
+        return;
+    }
+    std::cout << "Page store: " << pages << " pages of " << page_size << " bytes mapped from " << path << "."
+              << std::endl;
+}
+
+PageStore::~PageStore()
+{
+    if (data)
+    {
+        if (locked)
+        {
+            munlock(data, size);
+        }
+        munmap(data, size);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+bool PageStore::create_file(const std::string& path) const
+{
+    std::cout << "Creating page file " << path << " with " << pages << " generated pages." << std::endl;
+
+    const int out = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (out < 0)
+    {
+        perror("create page file");
+        return false;
+    }
+
+    std::vector<char> chunk(1 << 20);
+    for (size_t written = 0; written < size;)
+    {
+        const size_t length = std::min(chunk.size(), size - written);
+        generate(chunk.data(), written, length);
+        const ssize_t ret = write(out, chunk.data(), length);
+        if (ret < 0)
+        {
+            perror("write page file");
+            close(out);
+            unlink(path.c_str());
+            return false;
+        }
+        written += ret;
+    }
+
+    close(out);
+    return true;
+}
+
+bool PageStore::map(int flags, const std::string& huge_pages, const bool populate)
+{
+    const int prot = fd >= 0 ? PROT_READ : PROT_READ | PROT_WRITE;
+    const bool thp = huge_pages == "thp";
+
+    // Transparent huge pages have to be asked for before the first fault, so THP mappings are populated after
+    // the madvise instead of by mmap.
+    if (populate && !thp)
+    {
+        flags |= MAP_POPULATE;
+    }
+
+    void* mapping = MAP_FAILED;
+    if (huge_pages == "hugetlb")
+    {
+        mapping = mmap(nullptr, size, prot, flags | MAP_HUGETLB, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            perror("mmap page store with MAP_HUGETLB, falling back to normal pages");
+        }
+    }
+    if (mapping == MAP_FAILED)
+    {
+        mapping = mmap(nullptr, size, prot, flags, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            perror("mmap page store");
+            return false;
+        }
+    }
+
+    if (thp)
+    {
+        if (madvise(mapping, size, MADV_HUGEPAGE) < 0)
+        {
+            perror("madvise page store MADV_HUGEPAGE");
+        }
+        if (populate && madvise(mapping, size, fd >= 0 ? MADV_POPULATE_READ : MADV_POPULATE_WRITE) < 0)
+        {
+            perror("madvise page store MADV_POPULATE");
+        }
+    }
+
+    data = (char*)mapping;
+    return true;
+}
+
+bool PageStore::compute_checksums()
+{
+    checksums.resize(pages);
+    if (mapped())
+    {
+        for (uint32_t page_number = 0; page_number < pages; ++page_number)
+        {
+            checksums[page_number] = crc32c(page(page_number), page_size);
+        }
+    }
+    else
+    {
+        // Whole pages at a time, into a buffer aligned for O_DIRECT.
+        const size_t chunk_pages = std::max<size_t>(1, (1 << 20) / page_size);
+        const size_t chunk_size = chunk_pages * page_size;
+        char* chunk = (char*)std::aligned_alloc(4096, (chunk_size + 4095) / 4096 * 4096);
+        if (!chunk)
+        {
+            perror("aligned_alloc checksum chunk");
+            return false;
+        }
+        for (uint32_t first = 0; first < pages; first += chunk_pages)
+        {
+            const size_t count = std::min<size_t>(chunk_pages, pages - first);
+            for (size_t done = 0; done < count * page_size;)
+            {
+                const ssize_t ret = pread(fd, chunk + done, count * page_size - done, file_offset(first) + done);
+                if (ret <= 0)
+                {
+                    perror("pread page file");
+                    std::free(chunk);
+                    return false;
+                }
+                done += ret;
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                checksums[first + i] = crc32c(chunk + i * page_size, page_size);
+            }
+        }
+        std::free(chunk);
+    }
+    std::cout << "Page store: checksums of " << pages << " pages computed with " << crc32c_isa() << " CRC32C."
+              << std::endl;
+    return true;
+}
+
+void PageStore::generate(char* target, const size_t first_byte, const size_t length) const
+{
+    PageKernels::pseudo_random(PAGE_SEED).fill(target, first_byte, length);
+}
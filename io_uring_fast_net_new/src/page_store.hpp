@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The dataset PROTOCOL=page serves, page_count pages of page_size bytes that workers only ever read. It is either
+// generated at startup into anonymous memory, or memory-mapped from a dataset file so that it can be far larger
+// than what fits in a copy; responses then go to the socket straight from the mapping (sendmsg / sendmsg_zc) or
+// from the file through a pipe (splice). A dataset file that does not exist yet is created with the generated
+// content first. Byte i of generated data is (i * 2654435761 + PAGE_SEED) % 256, fast_net's pseudo-random filling
+// strategy, so a client can check any page without a copy of the data. A direct store only opens the file with
+// O_DIRECT and maps nothing, the server then reads every page it sends from disk.
+class PageStore
+{
+public:
+    static constexpr uint32_t PAGE_SEED = 42;
+
+    // huge_pages: "none", "thp" (madvise(MADV_HUGEPAGE)) or "hugetlb" (MAP_HUGETLB, which for a dataset file
+    // needs the file on a hugetlbfs mount). populate prefaults the whole mapping with MAP_POPULATE.
+    PageStore(uint32_t page_count, uint32_t page_size, const std::string& path = "",
+              const std::string& huge_pages = "none", bool populate = false, bool direct = false);
+    ~PageStore();
+
+    PageStore(const PageStore&) = delete;
+    PageStore& operator=(const PageStore&) = delete;
+
+    bool valid() const { return data != nullptr || (direct && fd >= 0 && pages > 0); }
+
+    // Whether page() may be used, false for a direct store.
+    bool mapped() const { return data != nullptr; }
+
+    bool contains(uint32_t page_number) const { return page_number < pages; }
+
+    const char* page(uint32_t page_number) const { return data + (size_t)page_number * page_size; }
+
+    uint32_t page_count() const { return pages; }
+
+    // The dataset file and the offset of a page in it, -1 for a generated store.
+    int file_fd() const { return fd; }
+    uint64_t file_offset(uint32_t page_number) const { return (uint64_t)page_number * page_size; }
+
+    // Computes the CRC32C of every page once, for the headers of PAGE_CHECKSUMS responses. A direct store reads
+    // the whole file for it. Returns false if the pages could not be read.
+    bool compute_checksums();
+
+    uint32_t checksum(uint32_t page_number) const { return checksums[page_number]; }
+
+private:
+    bool create_file(const std::string& path) const;
+    bool map(int flags, const std::string& huge_pages, bool populate);
+    void generate(char* target, size_t first_byte, size_t length) const;
+
+    uint32_t pages;
+    uint32_t page_size;
+    size_t size;
+    char* data = nullptr;
+    int fd = -1;
+    bool locked = false;
+    bool direct;
+    std::vector<uint32_t> checksums;
+};
@@ -0,0 +1,95 @@
+#include "ring_utils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+#include "static_config.hpp"
+#include "thread_utils.hpp"
+
+namespace
+{
+constexpr int MAX_SQPOLL_THREADS = 256;
+
+// Ring fd + 1 of every poller owner once it exists, 0 while it is being set up, -1 if that failed.
+std::atomic<int> sqpoll_owner_fds[MAX_SQPOLL_THREADS];
+
+int wait_for_sqpoll_owner(const int poller)
+{
+    int value;
+    while ((value = sqpoll_owner_fds[poller].load(std::memory_order_acquire)) == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return value > 0 ? value - 1 : -1;
+}
+}
+
+bool setup_ring(struct io_uring& ring, unsigned flags, const int ring_index)
+{
+    struct io_uring_params params = {};
+    int poller = -1;
+
+    if (config.sqpoll)
+    {
+        // The poller thread is the only submitter, which rules out DEFER_TASKRUN.
+        params.flags = IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = config.sqpoll_idle_ms;
+
+        const int poller_count = config.sqpoll_threads > 0 ? config.sqpoll_threads : ring_index + 1;
+        poller = ring_index % poller_count;
+        if (poller >= MAX_SQPOLL_THREADS)
+        {
+            poller = -1;
+        }
+
+        if (poller >= 0 && poller != ring_index)
+        {
+            const int owner_fd = wait_for_sqpoll_owner(poller);
+            if (owner_fd >= 0)
+            {
+                params.flags |= IORING_SETUP_ATTACH_WQ;
+                params.wq_fd = owner_fd;
+            }
+        }
+
+        if (!(params.flags & IORING_SETUP_ATTACH_WQ) && config.sqpoll_cpu >= 0)
+        {
+            params.flags |= IORING_SETUP_SQ_AFF;
+            params.sq_thread_cpu = (config.sqpoll_cpu + (poller >= 0 ? poller : ring_index)) % get_num_cpus();
+        }
+    }
+    else
+    {
+        params.flags = flags;
+    }
+
+    int ret = io_uring_queue_init_params(config.queue_depth, &ring, &params);
+    if (config.sqpoll && poller == ring_index)
+    {
+        sqpoll_owner_fds[poller].store(ret ? -1 : ring.ring_fd + 1, std::memory_order_release);
+    }
+    if (ret)
+    {
+        std::cerr << "io_uring_queue_init: " << strerror(-ret) << std::endl;
+        return false;
+    }
+
+    // Waiting for completions busy polls the NAPI contexts of the ring's sockets instead of sleeping until
+    // the interrupt, the ring keeps running without it if the kernel lacks support.
+    if (config.napi_busy_poll_us > 0)
+    {
+        struct io_uring_napi napi = {};
+        napi.busy_poll_to = config.napi_busy_poll_us;
+        napi.prefer_busy_poll = config.napi_prefer_busy_poll ? 1 : 0;
+        ret = io_uring_register_napi(&ring, &napi);
+        if (ret < 0)
+        {
+            std::cerr << "io_uring_register_napi: " << strerror(-ret) << std::endl;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <liburing.h>
+
+// A batch of CQEs can queue more SQEs than the SQ holds, flush it instead of failing. With SQPOLL the submit only
+// wakes the poller thread, the entries are free again once it has consumed them.
+inline struct io_uring_sqe* get_sqe(struct io_uring& ring)
+{
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    if (!sqe)
+    {
+        io_uring_submit(&ring);
+        if (ring.flags & IORING_SETUP_SQPOLL)
+        {
+            io_uring_sqring_wait(&ring);
+        }
+        sqe = io_uring_get_sqe(&ring);
+    }
+    return sqe;
+}
+
+// The CQE after head, only meaningful while head is not the last ready CQE.
+inline const struct io_uring_cqe* next_cqe(const struct io_uring& ring, const unsigned head)
+{
+    return &ring.cq.cqes[(head + 1) & ring.cq.ring_mask];
+}
+
+// Creates a worker ring of config.queue_depth entries with the given setup flags. With SQPOLL the flags are
+// replaced by a kernel submission thread: ring ring_index gets its own poller if ring_index < SQPOLL_THREADS
+// (or SQPOLL_THREADS is 0), otherwise it attaches to poller ring_index % SQPOLL_THREADS via
+// IORING_SETUP_ATTACH_WQ.
+bool setup_ring(struct io_uring& ring, unsigned flags, int ring_index);
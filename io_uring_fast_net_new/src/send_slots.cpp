@@ -0,0 +1,124 @@
+#include "send_slots.hpp"
+
+#include "latency_histogram.hpp"
+#include "static_config.hpp"
+
+SendSlots::SendSlots(uint32_t slot_count, int threshold)
+    : threshold(threshold), timed_bucket(slot_count, NOT_TIMED), timed_zero_copy(slot_count, false),
+      timed_since(slot_count, 0), timed_length(slot_count, 0), timed_sent(slot_count, 0),
+      timed_failed(slot_count, false), sending(slot_count, false), notifs_pending(slot_count, 0), waiting(slot_count)
+{
+}
+
+bool SendSlots::use_zero_copy(uint32_t slot, uint32_t length)
+{
+    if (threshold != Config::SEND_ZC_AUTO)
+    {
+        return threshold >= 0 && length >= (uint32_t)threshold;
+    }
+    const int index = length == 0 ? 0 : 31 - __builtin_clz(length);
+    Bucket& bucket = buckets[index];
+    if (bucket.settled)
+    {
+        return bucket.zero_copy;
+    }
+    // Whichever way went out less often so far goes next, so both see the same mix of load.
+    const bool zero_copy = bucket.issued[1] < bucket.issued[0];
+    ++bucket.issued[zero_copy];
+    timed_bucket[slot] = index;
+    timed_zero_copy[slot] = zero_copy;
+    timed_since[slot] = 0;
+    timed_length[slot] = length;
+    timed_sent[slot] = 0;
+    timed_failed[slot] = false;
+    return zero_copy;
+}
+
+void SendSlots::on_submit(uint32_t slot)
+{
+    sending[slot] = true;
+    if (timed_bucket[slot] != NOT_TIMED && timed_since[slot] == 0)
+    {
+        // A message parked behind others on its socket is timed from when its first send is actually issued.
+        timed_since[slot] = monotonic_ns();
+    }
+}
+
+void SendSlots::record(uint32_t slot)
+{
+    Bucket& bucket = buckets[timed_bucket[slot]];
+    const bool zero_copy = timed_zero_copy[slot];
+    timed_bucket[slot] = NOT_TIMED;
+    if (timed_failed[slot] || timed_since[slot] == 0 || bucket.settled)
+    {
+        return;
+    }
+    ++bucket.samples[zero_copy];
+    bucket.nanos[zero_copy] += monotonic_ns() - timed_since[slot];
+    bucket.bytes[zero_copy] += timed_length[slot];
+    if (bucket.samples[0] >= CALIBRATION_SAMPLES && bucket.samples[1] >= CALIBRATION_SAMPLES)
+    {
+        bucket.settled = true;
+        bucket.zero_copy = (double)bucket.nanos[1] / bucket.bytes[1] < (double)bucket.nanos[0] / bucket.bytes[0];
+    }
+}
+
+int SendSlots::calibrated_threshold() const
+{
+    int crossover = -1;
+    for (int index = 30; index >= 0; --index)
+    {
+        if (!buckets[index].settled)
+        {
+            continue;
+        }
+        if (!buckets[index].zero_copy)
+        {
+            break;
+        }
+        crossover = 1 << index;
+    }
+    return crossover;
+}
+
+bool SendSlots::on_complete(uint32_t slot, int res, uint32_t cqe_flags)
+{
+    const bool notif = cqe_flags & IORING_CQE_F_NOTIF;
+    if (notif)
+    {
+        --notifs_pending[slot];
+    }
+    else
+    {
+        // A zero-copy result with F_MORE still has its notification coming, everything else is done with the
+        // buffer.
+        sending[slot] = false;
+        if (cqe_flags & IORING_CQE_F_MORE)
+        {
+            ++notifs_pending[slot];
+        }
+        if (timed_bucket[slot] != NOT_TIMED)
+        {
+            timed_failed[slot] |= res <= 0;
+            timed_sent[slot] += res > 0 ? res : 0;
+        }
+    }
+    // A timed message is done once all of it went out, or a send of it failed, and the slot is released.
+    if (timed_bucket[slot] != NOT_TIMED && (timed_failed[slot] || timed_sent[slot] >= timed_length[slot]) &&
+        available(slot))
+    {
+        record(slot);
+    }
+    return notif;
+}
+
+bool SendSlots::take_waiter(uint32_t slot, Waiter& waiter)
+{
+    if (!available(slot) || waiting[slot].empty())
+    {
+        return false;
+    }
+    waiter = waiting[slot].front();
+    waiting[slot].pop_front();
+    return true;
+}
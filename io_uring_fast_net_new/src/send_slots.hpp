@@ -0,0 +1,94 @@
+#pragma once
+
+#include <liburing.h>
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "page_protocol.hpp"
+
+// Life of the send buffer slots. A plain send is done with its buffer once its CQE arrives, a zero-copy send
+// posts its result with IORING_CQE_F_MORE and only hands the buffer back with a second CQE flagged
+// IORING_CQE_F_NOTIF, once the NIC no longer references the pages. A message that went out in several sends, the
+// rest of a partial write continued from the same slot, has a notification coming for each zero-copy send of it.
+// Sends that want a slot still in use wait in that slot's queue until it is released.
+//
+// With SEND_ZC_THRESHOLD=auto the threshold is found online. Messages are put in power-of-two size buckets, and
+// the first messages of each bucket alternate between send and send_zc. Each is timed per byte from its first
+// send being issued until its slot is released: the last result CQE for send, the last notification for
+// send_zc. That is how long the buffer stays out of use, wall time that includes the event loop's own delays,
+// not the CPU either way costs. Once both have CALIBRATION_SAMPLES samples, the bucket keeps the faster one.
+class SendSlots
+{
+public:
+    struct Waiter
+    {
+        uint32_t conn;
+        uint16_t generation;
+        GetPagesRequest request; // what the send answers, with PROTOCOL=page
+    };
+
+    static constexpr uint32_t CALIBRATION_SAMPLES = 64;
+
+    // threshold: smallest message sent with send_zc, -1 never uses zero-copy, Config::SEND_ZC_AUTO calibrates.
+    SendSlots(uint32_t slot_count, int threshold);
+
+    // Picks send or send_zc for a message of length bytes from slot. While the message's size bucket is still
+    // calibrating, the message is timed.
+    bool use_zero_copy(uint32_t slot, uint32_t length);
+
+    bool available(uint32_t slot) const { return !sending[slot] && notifs_pending[slot] == 0; }
+
+    // Takes the slot for a message whose first send is not issued yet, it may still wait for its socket.
+    void reserve(uint32_t slot) { sending[slot] = true; }
+
+    void on_submit(uint32_t slot);
+
+    // Advances the slot for a CQE of one of its sends, res is the CQE result. Returns true if the CQE is a
+    // zero-copy notification, which carries no send result and must not be counted.
+    bool on_complete(uint32_t slot, int res, uint32_t cqe_flags);
+
+    void defer(uint32_t slot, const Waiter& waiter) { waiting[slot].push_back(waiter); }
+
+    // Pops the next send waiting for slot, if the slot is free.
+    bool take_waiter(uint32_t slot, Waiter& waiter);
+
+    uint64_t zero_copy_sends() const { return zc_sends; }
+    uint64_t copied_sends() const { return copy_sends; }
+
+    void count_send(bool zero_copy) { ++(zero_copy ? zc_sends : copy_sends); }
+
+    // Smallest size bucket from which calibration settled on send_zc for every bucket it settled, -1 if none.
+    int calibrated_threshold() const;
+
+private:
+    static constexpr int NOT_TIMED = -1;
+
+    struct Bucket
+    {
+        uint32_t issued[2] = {0, 0}; // indexed by zero_copy
+        uint32_t samples[2] = {0, 0};
+        uint64_t nanos[2] = {0, 0};
+        uint64_t bytes[2] = {0, 0};
+        bool settled = false;
+        bool zero_copy = false;
+    };
+
+    void record(uint32_t slot);
+
+    int threshold;
+    std::array<Bucket, 32> buckets;
+    std::vector<int8_t> timed_bucket;
+    std::vector<uint8_t> timed_zero_copy;
+    std::vector<uint64_t> timed_since; // 0 until the message's first send is issued
+    std::vector<uint32_t> timed_length;
+    std::vector<uint32_t> timed_sent;
+    std::vector<uint8_t> timed_failed;
+    std::vector<uint8_t> sending;
+    std::vector<uint16_t> notifs_pending;
+    std::vector<std::deque<Waiter>> waiting;
+    uint64_t zc_sends = 0;
+    uint64_t copy_sends = 0;
+};
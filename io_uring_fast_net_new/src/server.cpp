@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <liburing.h>
 #include <cstring>
@@ -16,217 +17,346 @@
 #include <netinet/tcp.h> 
 #include <fstream>    
 #include <ctime> 
-#include <unordered_map>
-
+#include <linux/filter.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <climits>
+
+#include "buffer_arena.hpp"
+#include "connection_table.hpp"
+#include "crc32c.hpp"
+#include "metrics.hpp"
+#include "page_cache.hpp"
+#include "page_protocol.hpp"
+#include "page_store.hpp"
+#include "ring_utils.hpp"
+#include "send_slots.hpp"
 #include "static_config.hpp"
 #include "thread_utils.hpp"
 
 using namespace std;
 
 int thread_count = -1;
-int next_thread = 0;
-std::vector<std::vector<uint16_t>> connection_fds;
+std::atomic<int> next_thread(0);
 std::atomic<bool> accepting_connections(true);
 
-struct UserData
-{
-    uint32_t buffer_idx;
-    bool is_send;
-    uint16_t fd;
-};
+// Ring fds the workers publish for the IORING_OP_MSG_RING connection hand-off, -1 if the worker failed to start.
+std::vector<int> worker_ring_fds;
+std::atomic<int> worker_rings_ready(0);
 
-uint64_t pack_user_data(const UserData& data)
-{
-    uint64_t result = 0;
-    result |= (uint64_t)(data.buffer_idx) & 0xFFFFFFFFULL; // bits 0..31
-    result |= ((uint64_t)(data.is_send ? 1 : 0) & 0x1ULL) << 32; // bit 32
-    result |= ((uint64_t)(data.fd) & 0xFFFFULL) << 33; // bits 33..48
-    return result;
-}
+// Buffer group id of the provided buffer ring used by MULTISHOT_RECV.
+constexpr int RECV_BUF_GROUP = 0;
 
-UserData unpack_user_data(uint64_t user_data)
-{
-    UserData data;
-    data.buffer_idx = (uint32_t)(user_data & 0xFFFFFFFFULL);
-    data.is_send = ((user_data >> 32) & 0x1ULL) != 0;
-    data.fd = (uint16_t)((user_data >> 33) & 0xFFFFULL);
-    return data;
-}
+// Bytes of one request on the wire: 4 with PROTOCOL=echo, a GetPageRequest with PROTOCOL=page, a GetPagesRequest
+// with PAGE_RANGE_REQUESTS.
+int request_size = 4;
 
-std::chrono::steady_clock::time_point server_start_time;
-std::atomic<bool> timer_started(false);
+// Most pages of a range one scatter-gather send answers, a longer range takes several sends of its slot.
+constexpr uint32_t BATCH_PAGES = 64;
+
+// Stride of the registered send buffers. PAGE_SEND_MODE=direct reads a page into its slot behind DIRECT_HEADER_ROOM
+// bytes whose tail holds the response header, so O_DIRECT gets an aligned buffer and the response still leaves in
+// one piece.
+constexpr int DIRECT_HEADER_ROOM = 4096;
+int send_slot_size = 0;
 
-struct Metrics
+// How a send slot's message goes out, and so how the rest of it is sent after a partial write.
+enum SendKind : uint8_t
 {
-    double timestamp;
-    int64_t message_count;
-    double throughput; 
-    double gbit_per_second;
+    SEND_PAGE, // the page in the slot's buffer, with PROTOCOL=echo and in half-duplex mode
+    SEND_MESSAGE, // a sendmsg of response iovecs
+    SEND_SPLICE, // a splice out of the slot's pipe
+    SEND_DIRECT, // header and page read into a registered buffer
 };
 
+// Registered buffer index of a worker's page cache arena, right behind the recv and send slots.
+int cache_buffer_index()
+{
+    return config.inflight_ops * 2;
+}
+
+static_assert(sizeof(GetPagesRequest) <= sizeof(ConnectionSlot::recv_partial), "recv_partial holds a request");
+static_assert(BATCH_PAGES * 2 <= IOV_MAX, "a batch fits one sendmsg");
+
 struct ThreadResult
 {
     int64_t total_message_count;
     int64_t total_bytes_sent;
     int64_t total_bytes_received;
     double duration;
-    std::vector<std::vector<Metrics>> per_second_metrics; 
+    std::vector<std::vector<MetricsRow>> per_second_metrics; 
+    BufferArena::Placement buffer_placement;
 };
 
+std::chrono::steady_clock::time_point server_start_time;
+std::atomic<bool> timer_started(false);
+std::once_flag timer_once;
+
+// Starts the run clock on the first accepted connection, whichever thread accepted it.
+void start_server_timer()
+{
+    std::call_once(timer_once, []
+    {
+        server_start_time = std::chrono::steady_clock::now();
+        timer_started.store(true);
+        cout << "Server timer started." << endl;
+    });
+}
+
+void configure_connection_socket(const int conn_fd)
+{
+    if (!config.enable_nagle)
+    {
+        int flag = 1;
+        int ret = setsockopt(conn_fd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int));
+        if (ret < 0)
+        {
+            perror("setsockopt TCP_NODELAY");
+        }
+    }
+
+    if (config.increase_socket_buffers)
+    {
+        int buf_size = 4 * 1024 * 1024; // 4MB
+        int ret = setsockopt(conn_fd, SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
+        if (ret < 0)
+        {
+            perror("setsockopt SO_SNDBUF");
+        }
+        ret = setsockopt(conn_fd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+        if (ret < 0)
+        {
+            perror("setsockopt SO_RCVBUF");
+        }
+    }
+}
+
+// With direct set the accepted sockets go straight into a free slot of the ring's file table
+// (IORING_FILE_INDEX_ALLOC) and cqe->res is that slot instead of an fd.
+bool arm_multishot_accept(struct io_uring& ring, const int listen_fd, const bool direct = false)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    if (direct)
+    {
+        io_uring_prep_multishot_accept_direct(sqe, listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+    }
+    else
+    {
+        io_uring_prep_multishot_accept(sqe, listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+    }
+    sqe->user_data = pack_user_data({0, OP_ACCEPT, 0, 0});
+    return true;
+}
+
+// Posts conn_fd to the ring of worker target_thread, which picks it up as an OP_HANDOFF completion.
+bool handoff_connection(struct io_uring& ring, const int target_thread, const int conn_fd)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    io_uring_prep_msg_ring(sqe, worker_ring_fds[target_thread], conn_fd, pack_user_data({0, OP_HANDOFF, 0, 0}), 0);
+    sqe->user_data = pack_user_data({0, OP_HANDOFF_SENT, (uint32_t)conn_fd, 0});
+    return true;
+}
+
+void wait_for_worker_rings()
+{
+    while (worker_rings_ready.load(std::memory_order_acquire) < thread_count)
+    {
+        std::this_thread::yield();
+    }
+}
+
 void accept_connections(const int listen_fd)
 {
     cout << "Acceptor thread started." << endl;
-    while (accepting_connections.load())
+
+    struct io_uring ring{};
+    int ret = io_uring_queue_init(64, &ring, 0);
+    if (ret)
+    {
+        std::cerr << "io_uring_queue_init: " << strerror(-ret) << std::endl;
+        accepting_connections = false;
+        return;
+    }
+
+    wait_for_worker_rings();
+
+    if (!arm_multishot_accept(ring, listen_fd))
     {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
+        accepting_connections = false;
+    }
+    io_uring_submit(&ring);
+
+    struct __kernel_timespec timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = 100 * 1000 * 1000;
 
-        int conn_fd = accept4(listen_fd, (struct sockaddr*)&client_addr, &client_len, SOCK_NONBLOCK);
-        if (conn_fd >= 0)
+    while (accepting_connections.load())
+    {
+        struct io_uring_cqe* cqe;
+        ret = io_uring_wait_cqe_timeout(&ring, &cqe, &timeout);
+        if (ret < 0 && ret != -ETIME && ret != -EINTR)
         {
-            cout << "Accepted connection: fd=" << conn_fd << endl;
+            std::cerr << "io_uring_wait_cqe_timeout: " << strerror(-ret) << std::endl;
+            accepting_connections = false;
+            break;
+        }
 
-            if (!config.enable_nagle)
+        if (ret == 0)
+        {
+            UserData data = unpack_user_data(cqe->user_data);
+            if (data.op == OP_ACCEPT)
             {
-                int flag = 1;
-                int ret = setsockopt(conn_fd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int));
-                if (ret < 0)
+                if (cqe->res >= 0)
                 {
-                    perror("setsockopt TCP_NODELAY");
-                }
-            }
+                    const int conn_fd = cqe->res;
+                    cout << "Accepted connection: fd=" << conn_fd << endl;
 
-            if (config.increase_socket_buffers)
-            {
-                int buf_size = 4 * 1024 * 1024; // 4MB
-                int ret = setsockopt(conn_fd, SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
-                if (ret < 0)
-                {
-                    perror("setsockopt SO_SNDBUF");
+                    configure_connection_socket(conn_fd);
+                    start_server_timer();
+
+                    int assigned_thread = next_thread++ % thread_count;
+                    cout << "Adding fd " << conn_fd << " to thread " << assigned_thread << endl;
+                    if (worker_ring_fds[assigned_thread] < 0 || !handoff_connection(ring, assigned_thread, conn_fd))
+                    {
+                        close(conn_fd);
+                    }
                 }
-                ret = setsockopt(conn_fd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
-                if (ret < 0)
+                else
                 {
-                    perror("setsockopt SO_RCVBUF");
+                    std::cerr << "multishot accept: " << strerror(-cqe->res) << std::endl;
                 }
-            }
 
-            if (!timer_started.load())
-            {
-                server_start_time = std::chrono::steady_clock::now();
-                timer_started.store(true);
-                cout << "Server timer started." << endl;
+                if (!(cqe->flags & IORING_CQE_F_MORE))
+                {
+                    arm_multishot_accept(ring, listen_fd);
+                }
             }
-
+            else if (data.op == OP_HANDOFF_SENT && cqe->res < 0)
             {
-                int assigned_thread = next_thread % thread_count;
-                cout << "Adding fd " << conn_fd << " to thread " << assigned_thread << endl;
-                connection_fds[assigned_thread].push_back(conn_fd);
-                next_thread++;
+                std::cerr << "Handing off fd " << data.conn << " failed: " << strerror(-cqe->res) << std::endl;
+                close(data.conn);
             }
+            io_uring_cqe_seen(&ring, cqe);
+            io_uring_submit(&ring);
         }
-        else
+
+        if (timer_started.load())
         {
-            if (errno != EINTR && errno != EAGAIN)
+            auto now = std::chrono::steady_clock::now();
+            double elapsed_seconds = std::chrono::duration<double>(now - server_start_time).count();
+            if (elapsed_seconds >= config.run_duration_seconds)
             {
-                perror("accept");
+                cout << "Time limit reached. Stopping acceptor thread." << endl;
                 accepting_connections = false;
                 break;
             }
-
-            if (timer_started.load())
-            {
-                auto now = std::chrono::steady_clock::now();
-                double elapsed_seconds = std::chrono::duration<double>(now - server_start_time).count();
-                if (elapsed_seconds >= config.run_duration_seconds)
-                {
-                    cout << "Time limit reached. Stopping acceptor thread." << endl;
-                    accepting_connections = false;
-                    break;
-                }
-            }
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
     }
+
+    io_uring_queue_exit(&ring);
     cout << "Acceptor thread exiting." << endl;
 }
 
-bool setup_io_uring(struct io_uring& ring)
+bool setup_io_uring(struct io_uring& ring, const int thread_id)
 {
-    int ret;
-    struct io_uring_params params = {};
-    params.flags = IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
-    ret = io_uring_queue_init_params(config.queue_depth, &ring, &params);
-    if (ret)
+    return setup_ring(ring, IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN,
+                      thread_id);
+}
+
+// Registered buffers: recv slot i is index i, send slot i is index inflight_ops + i, and a page cache's arena
+// follows at cache_buffer_index().
+bool register_buffers(struct io_uring& ring, char* recv_buffers, char* send_buffers, const PageCache* cache)
+{
+    const int count = config.inflight_ops * 2 + (cache ? 1 : 0);
+    struct iovec* iovecs = new struct iovec[count];
+    for (int i = 0; i < config.inflight_ops; ++i)
     {
-        std::cerr << "io_uring_queue_init: " << strerror(-ret) << std::endl;
+        iovecs[i].iov_base = recv_buffers + i * request_size;
+        iovecs[i].iov_len = request_size;
+
+        iovecs[config.inflight_ops + i].iov_base = send_buffers + i * send_slot_size;
+        iovecs[config.inflight_ops + i].iov_len = send_slot_size;
+    }
+    if (cache)
+    {
+        iovecs[cache_buffer_index()] = cache->region();
+    }
+
+    int ret = io_uring_register_buffers(&ring, iovecs, count);
+    delete[] iovecs;
+
+    if (ret < 0)
+    {
+        std::cerr << "io_uring_register_buffers: " << strerror(-ret) << std::endl;
         return false;
     }
     return true;
 }
 
-bool setup_buffers(struct io_uring& ring, char*& recv_buffers, char*& send_buffers)
+// Bytes of the receive slots at the start of a worker's buffer arena, rounded up so the send slots behind them
+// start on a page.
+size_t recv_region_size()
+{
+    return ((size_t)config.inflight_ops * request_size + 4095) / 4096 * 4096;
+}
+
+size_t buffer_arena_size()
+{
+    return recv_region_size() + (size_t)config.inflight_ops * send_slot_size;
+}
+
+// With aligned allocations the slots are carved from the worker's arena, which is already placed and pinned.
+bool setup_buffers(struct io_uring& ring, char*& recv_buffers, char*& send_buffers, const PageCache* cache,
+                   const BufferArena& arena)
 {
     int ret;
 
     if (config.use_aligned_allocations)
     {
-        if (posix_memalign((void**)&recv_buffers, 4096, config.inflight_ops * 4) != 0 ||
-            posix_memalign((void**)&send_buffers, 4096, config.inflight_ops * config.page_size) != 0)
+        if (!arena.valid())
         {
-            perror("posix_memalign");
             io_uring_queue_exit(&ring);
             return false;
         }
+        recv_buffers = arena.base();
+        send_buffers = arena.base() + recv_region_size();
     }
     else
     {
-        recv_buffers = new char[config.inflight_ops * 4];
-        send_buffers = new char[config.inflight_ops * config.page_size];
-    }
+        recv_buffers = new char[config.inflight_ops * request_size];
+        send_buffers = new char[config.inflight_ops * send_slot_size];
 
-    if (config.alloc_pin)
-    {
-        ret = mlock(recv_buffers, config.inflight_ops * 4);
-        if (ret)
-        {
-            perror("mlock recv_buffers");
-            exit(-1);
-        }
-        ret = mlock(send_buffers, config.inflight_ops * config.page_size);
-        if (ret)
+        if (config.alloc_pin)
         {
-            perror("mlock send_buffers");
-            exit(-1);
+            ret = mlock(recv_buffers, config.inflight_ops * request_size);
+            if (ret)
+            {
+                perror("mlock recv_buffers");
+                exit(-1);
+            }
+            ret = mlock(send_buffers, config.inflight_ops * send_slot_size);
+            if (ret)
+            {
+                perror("mlock send_buffers");
+                exit(-1);
+            }
         }
     }
 
-    struct iovec* iovecs = new struct iovec[config.inflight_ops * 2];
-    for (int i = 0; i < config.inflight_ops; ++i)
-    {
-        iovecs[i].iov_base = recv_buffers + i * 4;
-        iovecs[i].iov_len = 4;
-
-        iovecs[config.inflight_ops + i].iov_base = send_buffers + i * config.page_size;
-        iovecs[config.inflight_ops + i].iov_len = config.page_size;
-    }
-
-    ret = io_uring_register_buffers(&ring, iovecs, config.inflight_ops * 2);
-    delete[] iovecs;
-
-    if (ret < 0)
+    if (!register_buffers(ring, recv_buffers, send_buffers, cache))
     {
-        std::cerr << "io_uring_register_buffers: " << strerror(-ret) << std::endl;
         io_uring_queue_exit(&ring);
-        if (config.use_aligned_allocations)
-        {
-            munlock(recv_buffers, config.inflight_ops * 4);
-            munlock(send_buffers, config.inflight_ops * config.page_size);
-            free(recv_buffers);
-            free(send_buffers);
-        }
-        else
+        if (!config.use_aligned_allocations)
         {
             delete[] recv_buffers;
             delete[] send_buffers;
@@ -241,352 +371,1470 @@ void cleanup_buffers(struct io_uring& ring, char* recv_buffers, char* send_buffe
 {
     io_uring_queue_exit(&ring);
 
+    if (config.use_aligned_allocations)
+    {
+        return;
+    }
+
     if (config.alloc_pin)
     {
-        munlock(recv_buffers, config.inflight_ops * 4);
-        munlock(send_buffers, config.inflight_ops * config.page_size);
+        munlock(recv_buffers, config.inflight_ops * request_size);
+        munlock(send_buffers, config.inflight_ops * send_slot_size);
     }
+    delete[] recv_buffers;
+    delete[] send_buffers;
+}
 
-    if (config.use_aligned_allocations)
+bool setup_buf_ring(struct io_uring& ring, struct io_uring_buf_ring*& buf_ring, char*& buf_ring_buffers)
+{
+    int ret;
+    const size_t total_size = (size_t)config.buf_ring_entries * config.buf_ring_buffer_size;
+
+    if (posix_memalign((void**)&buf_ring_buffers, 4096, total_size) != 0)
     {
-        free(recv_buffers);
-        free(send_buffers);
+        perror("posix_memalign buf_ring_buffers");
+        return false;
     }
-    else
+
+    if (config.alloc_pin)
+    {
+        ret = mlock(buf_ring_buffers, total_size);
+        if (ret)
+        {
+            perror("mlock buf_ring_buffers");
+            exit(-1);
+        }
+    }
+
+    buf_ring = io_uring_setup_buf_ring(&ring, config.buf_ring_entries, RECV_BUF_GROUP, 0, &ret);
+    if (!buf_ring)
+    {
+        std::cerr << "io_uring_setup_buf_ring: " << strerror(-ret) << std::endl;
+        free(buf_ring_buffers);
+        return false;
+    }
+
+    const int mask = io_uring_buf_ring_mask(config.buf_ring_entries);
+    for (int i = 0; i < config.buf_ring_entries; ++i)
     {
-        delete[] recv_buffers;
-        delete[] send_buffers;
+        io_uring_buf_ring_add(buf_ring, buf_ring_buffers + i * config.buf_ring_buffer_size,
+                              config.buf_ring_buffer_size, i, mask, i);
     }
+    io_uring_buf_ring_advance(buf_ring, config.buf_ring_entries);
+
+    return true;
 }
 
-void handle_connection(const int thread_id, ThreadResult& result, struct io_uring& ring,
-                       char* recv_buffers, char* send_buffers,
-                       std::unordered_map<int, int>& fd_to_conn_index)
+void cleanup_buf_ring(struct io_uring& ring, struct io_uring_buf_ring* buf_ring, char* buf_ring_buffers)
 {
-    int ret;
-    int inflight = 0;
-    int sqes_to_submit = 0;
+    io_uring_free_buf_ring(&ring, buf_ring, config.buf_ring_entries, RECV_BUF_GROUP);
 
-    int num_connections = connection_fds[thread_id].size();
+    if (config.alloc_pin)
+    {
+        munlock(buf_ring_buffers, (size_t)config.buf_ring_entries * config.buf_ring_buffer_size);
+    }
 
-    std::vector<int64_t> message_count(num_connections, 0);
-    std::vector<int64_t> total_bytes_sent(num_connections, 0);
-    std::vector<int64_t> total_bytes_received(num_connections, 0);
-    std::vector<int64_t> bytes_sent_since_last_report(num_connections, 0);
-    std::vector<int64_t> bytes_received_since_last_report(num_connections, 0);
-    std::vector<int64_t> messages_since_last_report(num_connections, 0);
+    free(buf_ring_buffers);
+}
 
-    auto start_time = std::chrono::steady_clock::now();
-    auto last_report_time = start_time;
+// One recv per connection stays armed and picks its buffers from the provided buffer ring, so a single
+// CQE may carry several requests. The kernel drops the multishot request on error or when the
+// ring runs dry, which is signalled by a CQE without IORING_CQE_F_MORE.
+bool arm_multishot_recv(struct io_uring& ring, const ConnectionTable& connections, const uint32_t conn)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    io_uring_prep_recv_multishot(sqe, connections.fd_of(conn), nullptr, 0, 0);
+    connections.flag_fixed(sqe);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUF_GROUP;
+    sqe->user_data = connections.user_data(conn, OP_RECV, 0);
+    return true;
+}
 
-    bool connection_active = true;
+bool queue_recv(struct io_uring& ring, const ConnectionTable& connections, const uint32_t conn,
+                const uint32_t buffer_idx, char* recv_buffers)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    io_uring_prep_recv(sqe, connections.fd_of(conn), recv_buffers + buffer_idx * request_size, request_size, 0);
+    connections.flag_fixed(sqe);
+    sqe->user_data = connections.user_data(conn, OP_RECV, buffer_idx);
+    return true;
+}
 
-    if (config.half_duplex_mode)
+// Sends the page in send slot buffer_idx from byte offset on, the rest of it after a partial write. Like every
+// send of a whole message it passes MSG_WAITALL, so the kernel keeps writing a short send itself and the CQE only
+// comes up short when the socket fails or the write is interrupted.
+bool queue_send(struct io_uring& ring, const ConnectionTable& connections, const uint32_t conn,
+                const uint32_t buffer_idx, char* send_buffers, const bool zero_copy, const uint32_t offset = 0)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    char* data = send_buffers + buffer_idx * send_slot_size + offset;
+    const size_t length = config.page_size - offset;
+    // Registered buffers: recv slot i is index i, send slot i is index inflight_ops + i.
+    if (zero_copy && config.fixed_buffers)
     {
-        memset(send_buffers, 0, config.page_size * config.inflight_ops);
+        io_uring_prep_send_zc_fixed(sqe, connections.fd_of(conn), data, length, MSG_WAITALL, 0,
+                                    config.inflight_ops + buffer_idx);
+    }
+    else if (zero_copy)
+    {
+        io_uring_prep_send_zc(sqe, connections.fd_of(conn), data, length, MSG_WAITALL, 0);
     }
     else
     {
-        for (int i = 0; i < config.inflight_ops; ++i)
-        {
-            memset(send_buffers + i * config.page_size, 0, config.page_size);
-        }
+        io_uring_prep_send(sqe, connections.fd_of(conn), data, length, MSG_WAITALL);
     }
+    connections.flag_fixed(sqe);
+    sqe->user_data = connections.user_data(conn, OP_SEND, buffer_idx);
+    return true;
+}
 
-    for (int i = 0; i < config.inflight_ops; ++i)
+// Drops the first written bytes of msg's iovecs, leaving the rest of a message after a partial write.
+void skip_written(struct msghdr& msg, size_t written)
+{
+    while (written > 0 && msg.msg_iovlen > 0)
     {
-        auto cfds_len = connection_fds[thread_id].size();
-        auto conn_fd = connection_fds[thread_id][i % cfds_len];
-
-        fd_to_conn_index[conn_fd] = i % cfds_len;
-
-        if (config.half_duplex_mode)
+        struct iovec& iov = msg.msg_iov[0];
+        const size_t taken = std::min(written, iov.iov_len);
+        iov.iov_base = (char*)iov.iov_base + taken;
+        iov.iov_len -= taken;
+        written -= taken;
+        if (iov.iov_len == 0)
         {
-            struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
-            if (!sqe)
-            {
-                std::cerr << "io_uring_get_sqe failed" << std::endl;
-                connection_active = false;
-                break;
-            }
-            // io_uring_prep_send(sqe, conn_fd, send_buffers + i * config.page_size, config.page_size, 0);
-            io_uring_prep_send_zc(sqe, conn_fd, send_buffers + i * config.page_size, config.page_size, 0, 0);
-            UserData data;
-            data.buffer_idx = i;
-            data.is_send = true;
-            data.fd = conn_fd;
-            sqe->user_data = pack_user_data(data);
-            ++sqes_to_submit;
-            ++inflight;
-        }
-        else
-        {
-            // Submit initial receive requests
-            struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
-            if (!sqe)
-            {
-                std::cerr << "io_uring_get_sqe failed" << std::endl;
-                connection_active = false;
-                break;
-            }
-            io_uring_prep_recv(sqe, conn_fd, recv_buffers + i * 4, 4, 0);
-            UserData data;
-            data.buffer_idx = i;
-            data.is_send = false;
-            data.fd = conn_fd;
-            sqe->user_data = pack_user_data(data);
-            ++sqes_to_submit;
-            ++inflight;
+            ++msg.msg_iov;
+            --msg.msg_iovlen;
         }
     }
+}
 
-    if (sqes_to_submit > 0)
+// Sends a PROTOCOL=page response as one message of two iovecs, the header and the page itself, which is sent
+// straight from the page store without a copy in user space. After a partial write msg holds what is left.
+bool queue_send_response(struct io_uring& ring, const ConnectionTable& connections, const uint32_t conn,
+                         const uint32_t buffer_idx, const struct msghdr* msg, const bool zero_copy)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
     {
-        ret = io_uring_submit(&ring);
-        if (ret < 0)
-        {
-            std::cerr << "io_uring_submit: " << strerror(-ret) << std::endl;
-            connection_active = false;
-        }
-        sqes_to_submit = 0;
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
     }
-
-    struct __kernel_timespec timeout;
-    timeout.tv_sec = 1;
-    timeout.tv_nsec = 0;
-
-    while (connection_active)
+    if (zero_copy)
     {
-        // Check time limit
-        if (timer_started.load())
-        {
-            auto now = std::chrono::steady_clock::now();
-            double elapsed_seconds = std::chrono::duration<double>(now - server_start_time).count();
-            if (elapsed_seconds >= config.run_duration_seconds)
+        io_uring_prep_sendmsg_zc(sqe, connections.fd_of(conn), msg, MSG_WAITALL);
+    }
+    else
+    {
+        io_uring_prep_sendmsg(sqe, connections.fd_of(conn), msg, MSG_WAITALL);
+    }
+    connections.flag_fixed(sqe);
+    sqe->user_data = connections.user_data(conn, OP_SEND, buffer_idx);
+    return true;
+}
+
+// PAGE_SEND_MODE=splice moves a PROTOCOL=page response without the page passing through user space: the header is
+// written into the send slot's pipe, the page spliced from the dataset file behind it, and then the whole response
+// spliced from the pipe into the socket. Only failures of the pipe fill post a CQE. With link the fill is linked to
+// the SQE queued right after it, the splice into the socket.
+bool queue_splice_fill(struct io_uring& ring, const ConnectionTable& connections, const uint32_t conn,
+                       const uint32_t buffer_idx, const GetPageResponseHeader* header, const int* pipe_fds,
+                       const PageStore& pages, const uint32_t page_number, const bool link)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    io_uring_prep_write(sqe, pipe_fds[1], header, GetPageResponseHeader::wire_size(config.page_checksums), 0);
+    sqe->flags |= IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = connections.user_data(conn, OP_SPLICE, buffer_idx);
+
+    sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    io_uring_prep_splice(sqe, pages.file_fd(), pages.file_offset(page_number), pipe_fds[1], -1, config.page_size, 0);
+    sqe->flags |= (link ? IOSQE_IO_LINK : 0) | IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = connections.user_data(conn, OP_SPLICE, buffer_idx);
+    return true;
+}
+
+// Splices length bytes of the response in the slot's pipe into the socket, all of it or the rest a short splice
+// left behind.
+bool queue_splice_out(struct io_uring& ring, const ConnectionTable& connections, const uint32_t conn,
+                      const uint32_t buffer_idx, const int* pipe_fds, const uint32_t length)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    io_uring_prep_splice(sqe, pipe_fds[0], -1, connections.fd_of(conn), -1, length, 0);
+    connections.flag_fixed(sqe);
+    sqe->user_data = connections.user_data(conn, OP_SEND, buffer_idx);
+    return true;
+}
+
+// The three SQEs of a spliced response as one chain, which posts a CQE for the splice into the socket.
+bool queue_splice_response(struct io_uring& ring, const ConnectionTable& connections, const uint32_t conn,
+                           const uint32_t buffer_idx, const GetPageResponseHeader* header, const int* pipe_fds,
+                           const PageStore& pages, const uint32_t page_number)
+{
+    // A chain split over two submissions would lose its links, so make room for all of it first.
+    if (io_uring_sq_space_left(&ring) < 3)
+    {
+        io_uring_submit(&ring);
+    }
+    return queue_splice_fill(ring, connections, conn, buffer_idx, header, pipe_fds, pages, page_number, true) &&
+        queue_splice_out(ring, connections, conn, buffer_idx, pipe_fds,
+                         GetPageResponseHeader::wire_size(config.page_checksums) + config.page_size);
+}
+
+// PAGE_SEND_MODE=direct: reads the page with O_DIRECT into a registered buffer, the send slot's or a page cache
+// frame, right behind the header already written there, and sends header and page from that buffer. room is the
+// start of the buffer's DIRECT_HEADER_ROOM and buffer_index its registered index. The read is linked to the
+// send, or with DIRECT_IOPOLL goes to the polled disk ring and the send follows once the read has been reaped.
+bool queue_direct_read(struct io_uring& ring, const ConnectionTable& connections, const uint32_t conn,
+                       const uint32_t buffer_idx, char* room, const uint32_t buffer_index, const PageStore& pages,
+                       const uint32_t page_number, const bool linked)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    io_uring_prep_read_fixed(sqe, pages.file_fd(), room + DIRECT_HEADER_ROOM, config.page_size,
+                             pages.file_offset(page_number), buffer_index);
+    if (linked)
+    {
+        sqe->flags |= IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+    }
+    sqe->user_data = connections.user_data(conn, OP_DISK_READ, buffer_idx);
+    return true;
+}
+
+bool queue_direct_send(struct io_uring& ring, const ConnectionTable& connections, const uint32_t conn,
+                       const uint32_t buffer_idx, char* room, const uint32_t buffer_index, const bool zero_copy,
+                       const uint32_t offset = 0)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    const size_t header_size = GetPageResponseHeader::wire_size(config.page_checksums);
+    char* response = room + DIRECT_HEADER_ROOM - header_size + offset;
+    const size_t length = header_size + config.page_size - offset;
+    if (zero_copy)
+    {
+        io_uring_prep_send_zc_fixed(sqe, connections.fd_of(conn), response, length, MSG_WAITALL, 0, buffer_index);
+    }
+    else
+    {
+        io_uring_prep_send(sqe, connections.fd_of(conn), response, length, MSG_WAITALL);
+    }
+    connections.flag_fixed(sqe);
+    sqe->user_data = connections.user_data(conn, OP_SEND, buffer_idx);
+    return true;
+}
+
+// Queues the first receives of a connection on its inflight slots [first_slot, first_slot + slot_count).
+// Returns the number of SQEs queued, or -1 if the SQ ran out.
+int arm_connection(struct io_uring& ring, const ConnectionTable& connections, const uint32_t conn,
+                   const int first_slot, const int slot_count, char* recv_buffers, const bool multishot_recv)
+{
+    if (multishot_recv)
+    {
+        return arm_multishot_recv(ring, connections, conn) ? 1 : -1;
+    }
+
+    for (int i = first_slot; i < first_slot + slot_count; ++i)
+    {
+        if (!queue_recv(ring, connections, conn, i, recv_buffers))
+        {
+            return -1;
+        }
+    }
+    return slot_count;
+}
+
+bool cancel_multishot_accept(struct io_uring& ring)
+{
+    struct io_uring_sqe* sqe = get_sqe(ring);
+    if (!sqe)
+    {
+        std::cerr << "io_uring_get_sqe failed" << std::endl;
+        return false;
+    }
+    io_uring_prep_cancel64(sqe, pack_user_data({0, OP_ACCEPT, 0, 0}), 0);
+    sqe->user_data = pack_user_data({0, OP_CANCEL, 0, 0});
+    return true;
+}
+
+// Serves the connections of one worker. Connections arrive on the ring itself, either accepted on listen_fd
+// (MULTISHOT_ACCEPT) or posted by another ring through IORING_OP_MSG_RING, and each one is served from the
+// moment its CQE shows up. A connection that closes gives its slot back for the next one.
+void handle_connection(const int thread_id, ThreadResult& result, struct io_uring& ring,
+                       char* recv_buffers, char* send_buffers,
+                       struct io_uring_buf_ring* buf_ring, char* buf_ring_buffers,
+                       ConnectionTable& connections, const int listen_fd, const PageStore& pages,
+                       struct io_uring* disk_ring, PageCache* cache)
+{
+    int ret;
+    int sqes_to_submit = 0;
+
+    const bool multishot_recv = config.multishot_recv && !config.half_duplex_mode;
+    const int buf_ring_mask = io_uring_buf_ring_mask(config.buf_ring_entries);
+    uint32_t next_send_slot = 0;
+
+    // The inflight slots are split evenly between the connections a worker is sized for, connection slot
+    // c owns [c * slots_per_connection, (c + 1) * slots_per_connection).
+    const int slots_per_connection = config.inflight_ops / config.connections_per_thread;
+    const bool balanced_accept = config.accept_policy == "balanced";
+    const bool round_robin_accept = config.accept_policy == "round_robin";
+    bool accept_armed = false;
+
+    bool connection_active = true;
+
+    if (config.half_duplex_mode)
+    {
+        memset(send_buffers, 0, send_slot_size * config.inflight_ops);
+    }
+    else
+    {
+        for (int i = 0; i < config.inflight_ops; ++i)
+        {
+            memset(send_buffers + i * send_slot_size, 0, send_slot_size);
+        }
+    }
+
+    SendSlots sends(config.inflight_ops, config.send_zc_threshold);
+
+    // With PROTOCOL=page a send slot holds the request it answers, and the headers and iovecs of its responses,
+    // all of which have to stay put until the kernel is done with the send. With PAGE_RANGE_REQUESTS that is up to
+    // BATCH_PAGES of each, which go out together in one sendmsg.
+    const bool page_protocol = config.protocol == "page";
+    const uint32_t header_size = GetPageResponseHeader::wire_size(config.page_checksums);
+    const uint32_t response_size = header_size + config.page_size;
+    const uint32_t batch_pages = page_protocol && config.page_range_requests ? BATCH_PAGES : 1;
+    const std::vector<char> invalid_page(page_protocol ? config.page_size : 0, (char)INVALID_PAGE_FILL);
+    const uint32_t invalid_checksum = crc32c(invalid_page.data(), invalid_page.size());
+    std::vector<GetPagesRequest> slot_requests(config.inflight_ops);
+    std::vector<GetPageResponseHeader> response_headers(page_protocol ? config.inflight_ops * batch_pages : 0);
+    std::vector<struct iovec> response_iovecs(page_protocol ? config.inflight_ops * batch_pages * 2 : 0);
+    std::vector<struct msghdr> response_msgs(page_protocol ? config.inflight_ops : 0);
+    // What a send slot's message is and how much of it the kernel has taken. A message may take several writes,
+    // each continued from where the last one stopped, and counts once the last byte went out.
+    std::vector<uint8_t> send_kinds(config.inflight_ops, SEND_PAGE);
+    std::vector<uint8_t> send_zero_copy(config.inflight_ops, 0);
+    std::vector<uint32_t> send_lengths(config.inflight_ops, 0);
+    std::vector<uint32_t> send_progress(config.inflight_ops, 0);
+    // The requests of one multishot receive buffer, decoded together.
+    std::vector<GetPagesRequest> decoded(multishot_recv ? config.buf_ring_buffer_size / request_size + 1 : 1);
+
+    // PAGE_SEND_MODE=splice gives every send slot a pipe that carries its responses from the dataset file to the
+    // socket. Responses for pages that are not in the file still go out with sendmsg.
+    const bool splice_mode = page_protocol && config.page_send_mode == "splice" && pages.file_fd() >= 0;
+    std::vector<int> splice_pipes(splice_mode ? config.inflight_ops * 2 : 0, -1);
+    std::vector<uint8_t> pipe_filled(splice_mode ? config.inflight_ops : 0, 0);
+    for (int i = 0; splice_mode && i < config.inflight_ops; ++i)
+    {
+        if (pipe2(&splice_pipes[i * 2], O_CLOEXEC) < 0)
+        {
+            perror("pipe2");
+            connection_active = false;
+            break;
+        }
+        if (response_size > 65536 && fcntl(splice_pipes[i * 2 + 1], F_SETPIPE_SZ, response_size) < 0)
+        {
+            perror("fcntl F_SETPIPE_SZ");
+        }
+    }
+
+    // PAGE_SEND_MODE=direct sends every page from its slot's registered buffer right after reading it from disk.
+    // With a polled disk ring, or while ORDERED_SENDS has another response on the socket, the read goes out on its
+    // own and the send is queued once it completes.
+    const bool direct_mode = page_protocol && config.page_send_mode == "direct" && !pages.mapped();
+    // Whether a direct read is linked to its send, which then reports only a failed read.
+    std::vector<uint8_t> direct_linked(direct_mode ? config.inflight_ops : 0, 0);
+    int disk_reads = 0;
+    // Set to null once the device turns out not to support polled reads, the disk ring is then only drained.
+    struct io_uring* polled_ring = disk_ring;
+    // The page cache frame a send slot's response is read into or sent from, -1 for the slot's own buffer.
+    std::vector<int> slot_frames(cache ? config.inflight_ops : 0, -1);
+
+    // A failed or short splice leaves bytes of its response in the pipe, which must not prefix the next one.
+    auto drain_pipe = [&](const uint32_t idx)
+    {
+        int pending = 0;
+        char scratch[4096];
+        while (ioctl(splice_pipes[idx * 2], FIONREAD, &pending) == 0 && pending > 0)
+        {
+            if (read(splice_pipes[idx * 2], scratch, std::min<int>(pending, sizeof(scratch))) <= 0)
             {
-                cout << "Time limit reached. Worker thread " << thread_id << " closing connection." << endl;
-                connection_active = false;
                 break;
             }
         }
+    };
+
+    // The responses to the request's page_count pages, at most batch_pages, as one message of a header and a page
+    // iovec per page. content replaces the page from the store, for a single page held somewhere else. An empty
+    // range gets one INVALID_PAGE_NUMBER response.
+    auto build_response = [&](const uint32_t idx, const GetPagesRequest& request, const char* content = nullptr)
+    {
+        GetPageResponseHeader* headers = &response_headers[idx * batch_pages];
+        struct iovec* iov = &response_iovecs[idx * batch_pages * 2];
+        const uint32_t responses = std::max(request.page_count, 1u);
+        for (uint32_t i = 0; i < responses; ++i)
+        {
+            const uint32_t page_number = request.page_number + i;
+            const bool found = request.page_count > 0 && pages.contains(page_number);
+            GetPageResponseHeader& header = headers[i];
+            header.request_id = request.request_id;
+            header.status = found ? SUCCESS : INVALID_PAGE_NUMBER;
+            header.page_number = page_number;
+            header.checksum = !config.page_checksums ? 0 : found ? pages.checksum(page_number) : invalid_checksum;
+            header.to_network_order();
+
+            iov[i * 2].iov_base = &header;
+            iov[i * 2].iov_len = header_size;
+            iov[i * 2 + 1].iov_base = const_cast<char*>(content ? content : found ? pages.page(page_number)
+                                                                                  : invalid_page.data());
+            iov[i * 2 + 1].iov_len = config.page_size;
+        }
+
+        struct msghdr& msg = response_msgs[idx];
+        msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = responses * 2;
+        return &msg;
+    };
+
+    // The registered buffer a direct response of slot idx lives in: its cache frame if it has one, else the slot.
+    auto direct_room = [&](const uint32_t idx)
+    {
+        return cache && slot_frames[idx] >= 0 ? cache->frame(slot_frames[idx]) : send_buffers + idx * send_slot_size;
+    };
+    auto direct_buffer_index = [&](const uint32_t idx)
+    {
+        return (uint32_t)(cache && slot_frames[idx] >= 0 ? cache_buffer_index() : config.inflight_ops + idx);
+    };
+
+    // Looks the page of a direct response up in the cache and gives the slot the frame it is sent from, or a
+    // frame to read it into on a miss. Returns whether the page is already there.
+    auto use_cache = [&](const uint32_t conn, const uint32_t idx, const uint32_t page_number)
+    {
+        ConnectionSlot& c = connections[conn];
+        int frame = cache->lookup(page_number);
+        const bool hit = frame >= 0;
+        if (hit)
+        {
+            bump(c.cache_hits, 1);
+            cache->pin(frame);
+        }
+        else
+        {
+            bool evicted;
+            frame = cache->admit(page_number, evicted);
+            bump(c.cache_misses, 1);
+            if (evicted)
+            {
+                bump(c.cache_evictions, 1);
+            }
+        }
+        slot_frames[idx] = frame;
+        return hit;
+    };
+
+    // Settles the cache frame of slot idx after a CQE of its send: a page read for the send is in the frame once
+    // the send went out, and the frame may be evicted again once the slot is free.
+    auto settle_frame = [&](const uint32_t idx, const bool send_notif, const int res)
+    {
+        const int frame = slot_frames[idx];
+        if (!send_notif)
+        {
+            cache->finish_load(frame, res > 0);
+        }
+        if (sends.available(idx))
+        {
+            cache->unpin(frame);
+            slot_frames[idx] = -1;
+        }
+    };
+
+    // Puts slot idx's message on its connection's socket, or what is left of it after a write that took written
+    // bytes of it.
+    auto send_message = [&](const uint32_t conn, const uint32_t idx, const uint32_t written)
+    {
+        const uint32_t offset = send_progress[idx];
+        bool queued;
+        if (send_kinds[idx] == SEND_MESSAGE)
+        {
+            skip_written(response_msgs[idx], written);
+            queued = queue_send_response(ring, connections, conn, idx, &response_msgs[idx], send_zero_copy[idx]);
+        }
+        else if (send_kinds[idx] == SEND_SPLICE && offset == 0 && !pipe_filled[idx])
+        {
+            queued = queue_splice_response(ring, connections, conn, idx, &response_headers[idx * batch_pages],
+                                           &splice_pipes[idx * 2], pages, slot_requests[idx].page_number);
+        }
+        else if (send_kinds[idx] == SEND_SPLICE)
+        {
+            // The pipe was filled while the response waited for the socket. A splice that finds only part of the
+            // response in it yet is continued like any partial write.
+            queued = queue_splice_out(ring, connections, conn, idx, &splice_pipes[idx * 2],
+                                      send_lengths[idx] - offset);
+        }
+        else if (send_kinds[idx] == SEND_DIRECT)
+        {
+            queued = queue_direct_send(ring, connections, conn, idx, direct_room(idx), direct_buffer_index(idx),
+                                       send_zero_copy[idx], offset);
+        }
+        else
+        {
+            queued = queue_send(ring, connections, conn, idx, send_buffers, send_zero_copy[idx], offset);
+        }
+        if (!queued)
+        {
+            return false;
+        }
+        sends.on_submit(idx);
+        ++sqes_to_submit;
+        return true;
+    };
+
+    // With ORDERED_SENDS PROTOCOL=page responses go onto a connection's socket one at a time. The kernel continues
+    // a partial write once the socket has room again, and another response must not land in the middle of it. A
+    // response that is ready while its connection is busy waits in the connection's queue.
+    const bool ordered_sends = page_protocol && config.ordered_sends;
+    std::vector<uint8_t> socket_busy(connections.capacity(), 0);
+    std::vector<std::deque<uint32_t>> ready_sends(ordered_sends ? connections.capacity() : 0);
+
+    auto transmit = [&](const uint32_t conn, const uint32_t idx)
+    {
+        if (socket_busy[conn])
+        {
+            ready_sends[conn].push_back(idx);
+            return true;
+        }
+        socket_busy[conn] = ordered_sends;
+        return send_message(conn, idx, 0);
+    };
+
+    // The connection's socket is free again once a response is out in full or failed.
+    auto next_ready = [&](const uint32_t conn)
+    {
+        socket_busy[conn] = false;
+        if (ready_sends[conn].empty())
+        {
+            return true;
+        }
+        const uint32_t idx = ready_sends[conn].front();
+        ready_sends[conn].pop_front();
+        return transmit(conn, idx);
+    };
+
+    // Sends the response to request from buffer slot idx, or parks the send until the slot's previous send let go
+    // of the buffer. A range is answered by one sendmsg of up to batch_pages pages from the store, pages that are
+    // spliced or read from disk go one per send; the rest of the range waits for the slot again.
+    auto start_send = [&](const uint32_t conn, const uint32_t idx, GetPagesRequest request)
+    {
+        if (!sends.available(idx))
+        {
+            sends.defer(idx, {conn, connections[conn].generation, request});
+            return true;
+        }
+        // An empty range is answered with a single INVALID_PAGE_NUMBER response for its page_number.
+        const bool empty = page_protocol && request.page_count == 0;
+        const bool spliced = splice_mode && !empty && pages.contains(request.page_number);
+        const bool read_direct = direct_mode && !empty && pages.contains(request.page_number);
+        GetPagesRequest rest = request;
+        request.page_count = std::min(request.page_count, spliced || read_direct ? 1 : batch_pages);
+        rest.page_number += request.page_count;
+        rest.page_count -= request.page_count;
+        slot_requests[idx] = request;
+        const uint32_t message_size =
+            page_protocol ? response_size * std::max(request.page_count, 1u) : config.page_size;
+        const bool zero_copy = !spliced && sends.use_zero_copy(idx, message_size);
+        send_kinds[idx] = SEND_MESSAGE;
+        send_zero_copy[idx] = zero_copy;
+        send_lengths[idx] = message_size;
+        send_progress[idx] = 0;
+        sends.reserve(idx);
+        sends.count_send(zero_copy);
+        bool queued;
+        const bool cache_hit = read_direct && cache && use_cache(conn, idx, request.page_number);
+        if (cache_hit && cache->pins(slot_frames[idx]) > 1)
+        {
+            // Another send already has its header in the frame, this one sends its own next to the cached page.
+            build_response(idx, request, cache->page(slot_frames[idx]));
+            queued = transmit(conn, idx);
+        }
+        else if (read_direct)
+        {
+            send_kinds[idx] = SEND_DIRECT;
+            char* room = direct_room(idx);
+            const uint32_t buffer_index = direct_buffer_index(idx);
+            // Only the header's wire bytes fit in front of the page, which a cached frame already holds.
+            GetPageResponseHeader header;
+            header.request_id = request.request_id;
+            header.status = SUCCESS;
+            header.page_number = request.page_number;
+            header.checksum = config.page_checksums ? pages.checksum(request.page_number) : 0;
+            header.to_network_order();
+            memcpy(room + DIRECT_HEADER_ROOM - header_size, &header, header_size);
+
+            direct_linked[idx] = false;
+            if (cache_hit)
+            {
+                queued = transmit(conn, idx);
+            }
+            else if (polled_ring)
+            {
+                queued = queue_direct_read(*polled_ring, connections, conn, idx, room, buffer_index, pages,
+                                           request.page_number, false);
+                ++disk_reads;
+            }
+            else if (socket_busy[conn])
+            {
+                // The send waits its turn once the page is in, the read posts its own completion.
+                queued = queue_direct_read(ring, connections, conn, idx, room, buffer_index, pages,
+                                           request.page_number, false);
+                ++sqes_to_submit;
+            }
+            else
+            {
+                // Both halves of the link have to go out in the same submission.
+                if (io_uring_sq_space_left(&ring) < 2)
+                {
+                    io_uring_submit(&ring);
+                }
+                direct_linked[idx] = true;
+                socket_busy[conn] = ordered_sends;
+                queued = queue_direct_read(ring, connections, conn, idx, room, buffer_index, pages,
+                                           request.page_number, true) &&
+                    send_message(conn, idx, 0);
+            }
+        }
+        else if (spliced)
+        {
+            send_kinds[idx] = SEND_SPLICE;
+            build_response(idx, request);
+            // The pipe can be filled while the socket still carries another response, only the splice out of it
+            // has to wait its turn.
+            pipe_filled[idx] = socket_busy[conn];
+            queued = (!pipe_filled[idx] || queue_splice_fill(ring, connections, conn, idx,
+                                                             &response_headers[idx * batch_pages],
+                                                             &splice_pipes[idx * 2], pages, request.page_number,
+                                                             false)) &&
+                transmit(conn, idx);
+        }
+        else if (page_protocol)
+        {
+            build_response(idx, request);
+            queued = transmit(conn, idx);
+        }
+        else
+        {
+            send_kinds[idx] = SEND_PAGE;
+            queued = transmit(conn, idx);
+        }
+        if (!queued)
+        {
+            return false;
+        }
+        if (page_protocol && rest.page_count > 0)
+        {
+            sends.defer(idx, {conn, connections[conn].generation, rest});
+        }
+        return true;
+    };
+
+    // Pages that are spliced or read from disk go one per send, so the pages of a range are spread over the send
+    // slots to be read and sent side by side rather than one after the other on slot idx. At most inflight_ops
+    // pages are started at once, the rest of the range waits for slot idx like that of a sendmsg. Pages past the end
+    // of the store are answered like any missing page, with INVALID_PAGE_NUMBER.
+    auto start_range = [&](const uint32_t conn, const uint32_t idx, GetPagesRequest request)
+    {
+        // Page numbers end at UINT32_MAX, a range reaching past it is cut there rather than wrap around to page 0.
+        request.page_count = (uint32_t)std::min<uint64_t>(request.page_count, (1ULL << 32) - request.page_number);
+        if ((!splice_mode && !direct_mode) || request.page_count == 0)
+        {
+            return start_send(conn, idx, request);
+        }
+        const uint32_t started = std::min(request.page_count, (uint32_t)config.inflight_ops);
+        for (uint32_t i = 0; i < started; ++i)
+        {
+            const uint32_t slot = i == 0 ? idx : next_send_slot++ % config.inflight_ops;
+            if (!start_send(conn, slot, {request.request_id, request.page_number + i, 1}))
+            {
+                return false;
+            }
+        }
+        if (started < request.page_count)
+        {
+            sends.defer(idx, {conn, connections[conn].generation,
+                              {request.request_id, request.page_number + started, request.page_count - started}});
+        }
+        return true;
+    };
+
+    auto resume_sends = [&](const uint32_t idx)
+    {
+        SendSlots::Waiter waiter;
+        while (sends.take_waiter(idx, waiter))
+        {
+            if (connections.get({idx, OP_SEND, waiter.conn, waiter.generation}) &&
+                !start_range(waiter.conn, idx, waiter.request))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Answers the request in the request_size bytes at data from send slot idx.
+    auto handle_request = [&](const uint32_t conn, const char* data, const uint32_t idx)
+    {
+        GetPagesRequest request{};
+        if (page_protocol)
+        {
+            decode_requests(data, 1, config.page_range_requests, &request);
+        }
+        return start_range(conn, idx, request);
+    };
+
+    auto start_connection = [&](const uint32_t conn)
+    {
+        if (config.half_duplex_mode)
+        {
+            for (int i = conn * slots_per_connection; i < (int)(conn + 1) * slots_per_connection; ++i)
+            {
+                if (!start_send(conn, i, {}))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        const int queued = arm_connection(ring, connections, conn, conn * slots_per_connection,
+                                          slots_per_connection, recv_buffers, multishot_recv);
+        if (queued < 0)
+        {
+            return false;
+        }
+        sqes_to_submit += queued;
+        return true;
+    };
 
+    auto take_connection = [&](const int new_fd)
+    {
+        const int conn = connections.add(new_fd);
+        if (conn < 0)
+        {
+            std::cerr << "Worker thread " << thread_id << " is full, rejecting fd " << new_fd << std::endl;
+            close(new_fd);
+            return true;
+        }
+        cout << "Worker thread " << thread_id << " serving connection: fd=" << new_fd << " slot=" << conn << endl;
+        return start_connection(conn);
+    };
+
+    // A balanced worker steps back once it holds its share, leaving the remaining connections in the
+    // backlog to the workers that still accept, and comes back when one of its connections closes.
+    auto update_accept = [&]()
+    {
+        const bool wants_more = !balanced_accept ||
+                                connections.active_count() < (uint32_t)config.connections_per_thread;
+        if (accept_armed && !wants_more)
+        {
+            if (cancel_multishot_accept(ring))
+            {
+                ++sqes_to_submit;
+            }
+            accept_armed = false;
+        }
+        else if (!accept_armed && wants_more)
+        {
+            if (arm_multishot_accept(ring, listen_fd, config.accept_direct))
+            {
+                ++sqes_to_submit;
+                accept_armed = true;
+            }
+        }
+    };
+
+    auto close_connection = [&](const uint32_t conn)
+    {
+        connections.remove(conn);
+        if (config.multishot_accept)
+        {
+            update_accept();
+        }
+        if (!ordered_sends)
+        {
+            return true;
+        }
+        // Responses still waiting for the socket never go out, their slots are free for whoever waits on them.
+        std::deque<uint32_t> dropped;
+        dropped.swap(ready_sends[conn]);
+        socket_busy[conn] = false;
+        for (const uint32_t idx : dropped)
+        {
+            sends.on_complete(idx, -ECANCELED, 0);
+            if (cache && slot_frames[idx] >= 0)
+            {
+                settle_frame(idx, false, -ECANCELED);
+            }
+            if (!resume_sends(idx))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Hands a page read for a direct response over to its send, or frees the slot if the read failed.
+    auto finish_disk_read = [&](const UserData& data, const int res)
+    {
+        const uint32_t idx = data.buffer_idx;
+        const bool alive = connections.get(data) != nullptr;
+        if (alive && res == config.page_size)
+        {
+            return transmit(data.conn, idx);
+        }
+
+        // The send never happens, so the slot is free again for whoever waits on it.
+        sends.on_complete(idx, -ECANCELED, 0);
+        if (cache && slot_frames[idx] >= 0)
+        {
+            settle_frame(idx, false, res < 0 ? res : -EIO);
+        }
+        if (alive && res == -EOPNOTSUPP)
+        {
+            if (polled_ring)
+            {
+                std::cerr << "Worker thread " << thread_id << ": the page file's device cannot poll, reading "
+                    "without IOPOLL." << std::endl;
+                polled_ring = nullptr;
+            }
+            if (!start_send(data.conn, idx, slot_requests[idx]))
+            {
+                return false;
+            }
+        }
+        else if (alive)
+        {
+            std::cerr << "Reading a page for slot " << data.conn << " failed: "
+                << (res < 0 ? strerror(-res) : "short read") << std::endl;
+            if (!close_connection(data.conn))
+            {
+                return false;
+            }
+        }
+        return resume_sends(idx);
+    };
+
+    // Hands the pages read on the polled disk ring over to their sends. IOPOLL completions only show up when the
+    // ring is entered to poll the device, so this runs on every pass of the loop while reads are outstanding.
+    auto reap_disk_reads = [&]()
+    {
+        io_uring_submit_and_get_events(disk_ring);
+
+        unsigned head;
+        unsigned count = 0;
+        bool ok = true;
         struct io_uring_cqe* cqe;
-        ret = io_uring_wait_cqe_timeout(&ring, &cqe, &timeout);
-        if (ret == -ETIME || ret == -EINTR)
+        io_uring_for_each_cqe(disk_ring, head, cqe)
+        {
+            ++count;
+            --disk_reads;
+            if (!finish_disk_read(unpack_user_data(cqe->user_data), cqe->res))
+            {
+                ok = false;
+                break;
+            }
+        }
+        io_uring_cq_advance(disk_ring, count);
+        return ok;
+    };
+
+    if (config.multishot_accept)
+    {
+        update_accept();
+        if (!accept_armed)
+        {
+            connection_active = false;
+        }
+    }
+
+    if (sqes_to_submit > 0)
+    {
+        ret = io_uring_submit(&ring);
+        if (ret < 0)
+        {
+            std::cerr << "io_uring_submit: " << strerror(-ret) << std::endl;
+            connection_active = false;
+        }
+        sqes_to_submit = 0;
+    }
+
+    struct __kernel_timespec timeout;
+    timeout.tv_sec = 1;
+    timeout.tv_nsec = 0;
+
+    // Handles one CQE, returns false if the worker has to stop.
+    auto process_cqe = [&](struct io_uring_cqe* cqe)
+    {
+        UserData data = unpack_user_data(cqe->user_data);
+        uint32_t buffer_idx = data.buffer_idx;
+        bool is_send = data.op == OP_SEND;
+        uint32_t conn = data.conn;
+
+        ConnectionSlot* slot = data.op <= OP_SEND ? connections.get(data) : nullptr;
+
+        // The buffer's state follows every send CQE, also those of connections closed in the meantime.
+        const bool send_notif = is_send && sends.on_complete(buffer_idx, cqe->res, cqe->flags);
+        // A send that wrote part of its message goes on from where it stopped, before its slot is settled or the
+        // message counted.
+        if (is_send && !send_notif && slot && cqe->res > 0 &&
+            (send_progress[buffer_idx] += cqe->res) < send_lengths[buffer_idx])
+        {
+            bump(slot->total_bytes_sent, cqe->res);
+            return send_message(conn, buffer_idx, cqe->res);
+        }
+        if (ordered_sends && is_send && !send_notif && slot && cqe->res != -EAGAIN && !next_ready(conn))
+        {
+            return false;
+        }
+        if (cache && is_send && slot_frames[buffer_idx] >= 0)
+        {
+            settle_frame(buffer_idx, send_notif, cqe->res);
+        }
+        if (splice_mode && is_send && !send_notif && (cqe->res <= 0 || !slot))
+        {
+            drain_pipe(buffer_idx);
+        }
+
+        if (data.op == OP_ACCEPT)
+        {
+            if (cqe->res >= 0)
+            {
+                start_server_timer();
+
+                if (config.accept_direct)
+                {
+                    // The kernel installed the socket straight into our file table, cqe->res is its slot.
+                    const uint32_t new_conn = cqe->res;
+                    if (!connections.add_direct(new_conn))
+                    {
+                        std::cerr << "Worker thread " << thread_id << " got unusable direct slot " << new_conn
+                            << std::endl;
+                    }
+                    else
+                    {
+                        cout << "Worker thread " << thread_id << " accepted connection: slot=" << new_conn << endl;
+                        if (!start_connection(new_conn))
+                        {
+                            return false;
+                        }
+                    }
+                }
+                else
+                {
+                    const int new_fd = cqe->res;
+                    cout << "Worker thread " << thread_id << " accepted connection: fd=" << new_fd << endl;
+                    configure_connection_socket(new_fd);
+
+                    const int target_thread = round_robin_accept ? next_thread++ % thread_count : thread_id;
+                    if (target_thread == thread_id)
+                    {
+                        if (!take_connection(new_fd))
+                        {
+                            return false;
+                        }
+                    }
+                    else if (worker_ring_fds[target_thread] < 0 || !handoff_connection(ring, target_thread, new_fd))
+                    {
+                        close(new_fd);
+                    }
+                    else
+                    {
+                        ++sqes_to_submit;
+                    }
+                }
+            }
+            else if (cqe->res != -ECANCELED)
+            {
+                std::cerr << "multishot accept: " << strerror(-cqe->res) << std::endl;
+            }
+
+            if (!(cqe->flags & IORING_CQE_F_MORE))
+            {
+                accept_armed = false;
+            }
+            if (cqe->res != -ECANCELED)
+            {
+                update_accept();
+            }
+        }
+        else if (data.op == OP_HANDOFF)
+        {
+            if (!take_connection(cqe->res))
+            {
+                return false;
+            }
+        }
+        else if (data.op == OP_HANDOFF_SENT)
+        {
+            if (cqe->res < 0)
+            {
+                std::cerr << "Handing off fd " << conn << " failed: " << strerror(-cqe->res) << std::endl;
+                close(conn);
+            }
+        }
+        else if (data.op == OP_DISK_READ && !direct_linked[buffer_idx])
+        {
+            return finish_disk_read(data, cqe->res);
+        }
+        else if (data.op == OP_DISK_READ)
+        {
+            // The linked send completes with -ECANCELED right after and closes the connection.
+            std::cerr << "Reading a page for slot " << conn << " failed: "
+                << (cqe->res < 0 ? strerror(-cqe->res) : "short read") << std::endl;
+        }
+        else if (data.op == OP_SPLICE)
+        {
+            // A chain's send completes with -ECANCELED right after, a pipe filled ahead of its send would leave
+            // the send waiting for bytes that never come. Either way the connection is closed.
+            std::cerr << "Splicing a response on slot " << conn << " failed: " << strerror(-cqe->res) << std::endl;
+            if (connections.get(data) && !close_connection(conn))
+            {
+                return false;
+            }
+        }
+        else if (data.op == OP_CANCEL)
+        {
+            // Nothing to do, the cancelled accept reports itself with -ECANCELED.
+        }
+        else if (send_notif)
         {
-            continue;
+            // The kernel is done with a zero-copy buffer, waiting sends are resumed below.
         }
-        else if (ret < 0)
+        else if (!slot)
         {
-            std::cerr << "io_uring_wait_cqe_timeout: " << strerror(-ret) << std::endl;
-            connection_active = false;
-            break;
+            // Late completion of a connection that has been closed since; its slot may serve another one by now.
+            if (cqe->flags & IORING_CQE_F_BUFFER)
+            {
+                const uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                io_uring_buf_ring_add(buf_ring, buf_ring_buffers + bid * config.buf_ring_buffer_size,
+                                      config.buf_ring_buffer_size, bid, buf_ring_mask, 0);
+                io_uring_buf_ring_advance(buf_ring, 1);
+            }
         }
-
-        UserData data = unpack_user_data(cqe->user_data);
-        uint32_t buffer_idx = data.buffer_idx;
-        bool is_send = data.is_send;
-        uint16_t conn_fd = data.fd;
-
-        int conn_index = fd_to_conn_index[conn_fd];
-
-        if (cqe->res < 0)
+        else if (cqe->res < 0)
         {
-            if (cqe->res == -EAGAIN)
+            if (multishot_recv && !is_send && (cqe->res == -EAGAIN || cqe->res == -ENOBUFS))
             {
-                struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
-                if (!sqe)
+                // The buffer ring ran dry before we recycled buffers; the multishot recv is gone.
+                if (!arm_multishot_recv(ring, connections, conn))
                 {
-                    std::cerr << "io_uring_get_sqe failed" << std::endl;
-                    connection_active = false;
-                    break;
+                    return false;
                 }
+                ++sqes_to_submit;
+            }
+            else if (cqe->res == -EAGAIN)
+            {
                 if (is_send)
                 {
-                    // io_uring_prep_send(sqe, conn_fd, send_buffers + buffer_idx * config.page_size, config.page_size, 0);
-                    io_uring_prep_send_zc(sqe, conn_fd, send_buffers + buffer_idx * config.page_size, config.page_size, 0, 0);
-                    UserData new_data = data; // Same data
-                    sqe->user_data = pack_user_data(new_data);
+                    // A response that has the socket keeps it for the retry.
+                    const bool queued = send_progress[buffer_idx] > 0 || socket_busy[conn]
+                                            ? send_message(conn, buffer_idx, 0)
+                                            : start_send(conn, buffer_idx, slot_requests[buffer_idx]);
+                    if (!queued)
+                    {
+                        return false;
+                    }
                 }
                 else
                 {
-                    io_uring_prep_recv(sqe, conn_fd, recv_buffers + buffer_idx * 4, 4, 0);
-                    UserData new_data = data; // Same data
-                    sqe->user_data = pack_user_data(new_data);
+                    if (!queue_recv(ring, connections, conn, buffer_idx, recv_buffers))
+                    {
+                        return false;
+                    }
+                    ++sqes_to_submit;
                 }
-                ++sqes_to_submit;
             }
             else if (cqe->res == -ECONNRESET || cqe->res == -EPIPE)
             {
-                if (config.verbose) cout << "Connection closed by client on fd " << conn_fd << endl;
-                connection_active = false;
-                break;
+                if (config.verbose) cout << "Connection closed by client on slot " << conn << endl;
+                if (!close_connection(conn))
+                {
+                    return false;
+                }
             }
             else
             {
-                std::cerr << "Operation error on fd " << conn_fd << ": " << strerror(-cqe->res) << std::endl;
-                connection_active = false;
-                break;
+                std::cerr << "Operation error on slot " << conn << ": " << strerror(-cqe->res) << std::endl;
+                if (!close_connection(conn))
+                {
+                    return false;
+                }
             }
         }
         else if (cqe->res == 0)
         {
-            cout << "Connection closed by client on fd " << conn_fd << endl;
-            connection_active = false;
-            break;
+            cout << "Connection closed by client on slot " << conn << endl;
+            if (!close_connection(conn))
+            {
+                return false;
+            }
         }
         else
         {
             if (is_send)
             {
                 int bytes_written = cqe->res;
-                if (config.verbose) cout << "Sent " << bytes_written << " bytes to fd " << conn_fd << endl;
-
-                total_bytes_sent[conn_index] += bytes_written;
-                bytes_sent_since_last_report[conn_index] += bytes_written;
+                if (config.verbose) cout << "Sent " << bytes_written << " bytes to slot " << conn << endl;
 
-                if (!config.half_duplex_mode)
-                {
-                    --inflight;
-                }
+                bump(slot->total_bytes_sent, bytes_written);
 
                 if (config.half_duplex_mode)
                 {
-                    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
-                    if (!sqe)
+                    if (!start_send(conn, buffer_idx, {}))
                     {
-                        std::cerr << "io_uring_get_sqe failed" << std::endl;
-                        connection_active = false;
-                        break;
+                        return false;
                     }
-                    io_uring_prep_send(sqe, conn_fd, send_buffers + buffer_idx * config.page_size, config.page_size, 0);
-                    UserData new_data = data; // Same data
-                    sqe->user_data = pack_user_data(new_data);
-                    ++sqes_to_submit;
                 }
 
-                ++message_count[conn_index];
+                // A batch is as many messages as it has pages.
+                bump(slot->message_count, std::max<uint32_t>(slot_requests[buffer_idx].page_count, 1));
+            }
+            else
+            {
+                int bytes_received = cqe->res;
+                if (config.verbose) cout << "Received " << bytes_received << " bytes from slot " << conn << endl;
+
+                bump(slot->total_bytes_received, bytes_received);
 
-                auto now = std::chrono::steady_clock::now();
-                double time_since_last_report = std::chrono::duration<double>(now - last_report_time).count();
-                if (time_since_last_report >= 1.0)
+                if (multishot_recv)
                 {
-                    double segment_duration = time_since_last_report;
+                    const uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                    char* data = buf_ring_buffers + bid * config.buf_ring_buffer_size;
+                    int offset = 0;
 
-                    for (int i = 0; i < num_connections; ++i)
+                    // A request split across two buffers is completed from the bytes kept in the slot.
+                    if (slot->recv_leftover > 0)
                     {
-                        double conn_throughput = (message_count[i] - messages_since_last_report[i]) / segment_duration;
-
-                        double data_transferred_bits =
-                            (bytes_sent_since_last_report[i] + bytes_received_since_last_report[i]) * 8;
-                        double conn_gbit_per_second = data_transferred_bits / (segment_duration * 1e9);
-
-                        cout << "Thread " << thread_id << ", connection " << i << " processed "
-                             << message_count[i] << " messages. Throughput: " << conn_throughput
-                             << " it/s, " << conn_gbit_per_second << " Gbit/s." << endl;
-
-                        Metrics m;
-                        m.timestamp = std::chrono::duration<double>(now - start_time).count();
-                        m.message_count = message_count[i];
-                        m.throughput = conn_throughput;
-                        m.gbit_per_second = conn_gbit_per_second;
-                        result.per_second_metrics[i].push_back(m);
-
-                        bytes_sent_since_last_report[i] = 0;
-                        bytes_received_since_last_report[i] = 0;
-                        messages_since_last_report[i] = message_count[i];
+                        offset = std::min(request_size - slot->recv_leftover, bytes_received);
+                        memcpy(slot->recv_partial + slot->recv_leftover, data, offset);
+                        slot->recv_leftover += offset;
+                        if (slot->recv_leftover == request_size)
+                        {
+                            slot->recv_leftover = 0;
+                            if (!handle_request(conn, slot->recv_partial, next_send_slot++ % config.inflight_ops))
+                            {
+                                return false;
+                            }
+                        }
+                    }
+                    const int count = (bytes_received - offset) / request_size;
+                    if (page_protocol)
+                    {
+                        decode_requests(data + offset, count, config.page_range_requests, decoded.data());
+                    }
+                    for (int i = 0; i < count; ++i, offset += request_size)
+                    {
+                        if (!start_range(conn, next_send_slot++ % config.inflight_ops,
+                                         page_protocol ? decoded[i] : GetPagesRequest{}))
+                        {
+                            return false;
+                        }
+                    }
+                    if (offset < bytes_received)
+                    {
+                        slot->recv_leftover = bytes_received - offset;
+                        memcpy(slot->recv_partial, data + offset, slot->recv_leftover);
                     }
-                    last_report_time = now;
-                }
-            }
-            else
-            {
-                int bytes_received = cqe->res;
-                if (config.verbose) cout << "Received " << bytes_received << " bytes from fd " << conn_fd << endl;
 
-                total_bytes_received[conn_index] += bytes_received;
-                bytes_received_since_last_report[conn_index] += bytes_received;
+                    io_uring_buf_ring_add(buf_ring, data, config.buf_ring_buffer_size, bid, buf_ring_mask, 0);
+                    io_uring_buf_ring_advance(buf_ring, 1);
 
-                if (config.half_duplex_mode)
+                    if (!(cqe->flags & IORING_CQE_F_MORE))
+                    {
+                        if (!arm_multishot_recv(ring, connections, conn))
+                        {
+                            return false;
+                        }
+                        ++sqes_to_submit;
+                    }
+                }
+                else if (config.half_duplex_mode)
                 {
-                    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
-                    if (!sqe)
+                    if (!queue_recv(ring, connections, conn, buffer_idx, recv_buffers))
                     {
-                        std::cerr << "io_uring_get_sqe failed" << std::endl;
-                        connection_active = false;
-                        break;
+                        return false;
                     }
-                    io_uring_prep_recv(sqe, conn_fd, recv_buffers + buffer_idx * 4, 4, 0);
-                    UserData new_data = data; 
-                    sqe->user_data = pack_user_data(new_data);
                     ++sqes_to_submit;
                 }
                 else
                 {
-                    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
-                    if (!sqe)
+                    // A receive may end inside a request, whichever receive of the connection completes next
+                    // brings the rest, which is put together in the connection's recv_partial.
+                    const char* data = recv_buffers + buffer_idx * request_size;
+                    if (slot->recv_leftover == 0 && bytes_received == request_size)
                     {
-                        std::cerr << "io_uring_get_sqe failed" << std::endl;
-                        connection_active = false;
-                        break;
+                        if (!handle_request(conn, data, buffer_idx))
+                        {
+                            return false;
+                        }
                     }
-                    io_uring_prep_send(sqe, conn_fd, send_buffers + buffer_idx * config.page_size, config.page_size, 0);
-                    UserData send_data;
-                    send_data.buffer_idx = buffer_idx;
-                    send_data.is_send = true;
-                    send_data.fd = conn_fd;
-                    sqe->user_data = pack_user_data(send_data);
-                    ++sqes_to_submit;
-                    ++inflight;
-
-                    struct io_uring_sqe* recv_sqe = io_uring_get_sqe(&ring);
-                    if (!recv_sqe)
+                    else
+                    {
+                        const int taken = std::min(request_size - slot->recv_leftover, bytes_received);
+                        memcpy(slot->recv_partial + slot->recv_leftover, data, taken);
+                        slot->recv_leftover += taken;
+                        if (slot->recv_leftover == request_size)
+                        {
+                            slot->recv_leftover = bytes_received - taken;
+                            if (!handle_request(conn, slot->recv_partial, buffer_idx))
+                            {
+                                return false;
+                            }
+                            memcpy(slot->recv_partial, data + taken, slot->recv_leftover);
+                        }
+                    }
+                    if (!queue_recv(ring, connections, conn, buffer_idx, recv_buffers))
                     {
-                        std::cerr << "io_uring_get_sqe failed" << std::endl;
-                        connection_active = false;
-                        break;
+                        return false;
                     }
-                    io_uring_prep_recv(recv_sqe, conn_fd, recv_buffers + buffer_idx * 4, 4, 0);
-                    UserData recv_data = data;
-                    recv_sqe->user_data = pack_user_data(recv_data);
                     ++sqes_to_submit;
-                    ++inflight;
                 }
             }
         }
 
-        io_uring_cqe_seen(&ring, cqe);
+        return !is_send || resume_sends(buffer_idx);
+    };
+
+    while (connection_active)
+    {
+        // Check time limit
+        if (timer_started.load())
+        {
+            auto now = std::chrono::steady_clock::now();
+            double elapsed_seconds = std::chrono::duration<double>(now - server_start_time).count();
+            if (elapsed_seconds >= config.run_duration_seconds)
+            {
+                cout << "Time limit reached. Worker thread " << thread_id << " closing connection." << endl;
+                connection_active = false;
+                break;
+            }
+        }
 
-        if (sqes_to_submit > 0)
+        // Submitting and waiting share one syscall, which is skipped while completions are still queued.
+        struct io_uring_cqe* cqe;
+        if (disk_reads > 0)
         {
-            ret = io_uring_submit(&ring);
-            if (ret < 0)
+            // Never sleep on the network ring while the disk ring has reads to poll for.
+            if (!reap_disk_reads())
             {
-                std::cerr << "io_uring_submit: " << strerror(-ret) << std::endl;
                 connection_active = false;
                 break;
             }
+            io_uring_submit_and_get_events(&ring);
+            sqes_to_submit = 0;
+            if (io_uring_cq_ready(&ring) == 0)
+            {
+                continue;
+            }
+        }
+        else if (sqes_to_submit > 0 || io_uring_cq_ready(&ring) == 0)
+        {
+            ret = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, &timeout, nullptr);
             sqes_to_submit = 0;
+            if (ret == -ETIME || ret == -EINTR)
+            {
+                continue;
+            }
+            else if (ret < 0)
+            {
+                std::cerr << "io_uring_submit_and_wait_timeout: " << strerror(-ret) << std::endl;
+                connection_active = false;
+                break;
+            }
         }
 
-        if (!connection_active || (inflight == 0 && !config.half_duplex_mode))
+        unsigned head;
+        unsigned count = 0;
+        const unsigned batch = std::min<unsigned>(io_uring_cq_ready(&ring), config.cqe_batch_size);
+        io_uring_for_each_cqe(&ring, head, cqe)
         {
-            break;
+            if (count == batch)
+            {
+                break;
+            }
+            // Pull the next completion's connection into cache while this one is handled.
+            if (count + 1 < batch)
+            {
+                connections.prefetch(unpack_user_data(next_cqe(ring, head)->user_data).conn);
+            }
+            if (!process_cqe(cqe))
+            {
+                connection_active = false;
+                break;
+            }
+            ++count;
         }
+        io_uring_cq_advance(&ring, count);
     }
 
     result.total_message_count = 0;
     result.total_bytes_sent = 0;
     result.total_bytes_received = 0;
-    for (int i = 0; i < num_connections; ++i)
+    for (uint32_t i = 0; i < connections.size(); ++i)
+    {
+        result.total_message_count += connections[i].message_count;
+        result.total_bytes_sent += connections[i].total_bytes_sent;
+        result.total_bytes_received += connections[i].total_bytes_received;
+    }
+
+    for (int fd : splice_pipes)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    if (cache)
+    {
+        int64_t hits = 0;
+        int64_t misses = 0;
+        int64_t evictions = 0;
+        for (uint32_t i = 0; i < connections.size(); ++i)
+        {
+            hits += connections[i].cache_hits;
+            misses += connections[i].cache_misses;
+            evictions += connections[i].cache_evictions;
+        }
+        cout << "Worker thread " << thread_id << " page cache of " << cache->frame_count() << " pages: " << hits
+            << " hits, " << misses << " misses, " << evictions << " evictions." << endl;
+    }
+
+    cout << "Worker thread " << thread_id << " sent " << sends.zero_copy_sends() << " pages with send_zc and "
+        << sends.copied_sends() << (splice_mode ? " with send or splice." : " with send.") << endl;
+    if (config.send_zc_threshold == Config::SEND_ZC_AUTO)
+    {
+        cout << "Worker thread " << thread_id << " calibrated SEND_ZC_THRESHOLD to " << sends.calibrated_threshold()
+            << "." << endl;
+    }
+}
+
+int create_listener(const bool reuseport)
+{
+    int ret;
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listen_fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    int optval = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+
+    if (reuseport)
+    {
+        ret = setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
+        if (ret < 0)
+        {
+            perror("setsockopt SO_REUSEPORT");
+            close(listen_fd);
+            return -1;
+        }
+    }
+
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+
+    ret = bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+    if (ret < 0)
+    {
+        perror("bind");
+        close(listen_fd);
+        return -1;
+    }
+
+    // Direct accepts never surface an fd to set options on, accepted sockets inherit them from the listener.
+    if (config.accept_direct)
+    {
+        configure_connection_socket(listen_fd);
+    }
+
+    ret = listen(listen_fd, SOMAXCONN);
+    if (ret < 0)
+    {
+        perror("listen");
+        close(listen_fd);
+        return -1;
+    }
+
+    return listen_fd;
+}
+
+// Picks the listener of a new flow by the CPU that processed its SYN: CPU c goes to socket c % listener_count.
+// Worker i is pinned to CPU i (see get_cpu_for_thread), so with PIN_THREADS and at least as many workers as
+// RX CPUs the softirq, the accept and every later completion of a flow stay on one core.
+bool attach_cpu_steering(const int listen_fd, const int listener_count)
+{
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)listener_count},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog prog = {};
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+
+    int ret = setsockopt(listen_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+    if (ret < 0)
     {
-        result.total_message_count += message_count[i];
-        result.total_bytes_sent += total_bytes_sent[i];
-        result.total_bytes_received += total_bytes_received[i];
+        perror("setsockopt SO_ATTACH_REUSEPORT_CBPF");
+        return false;
+    }
+    if (!config.pin_threads)
+    {
+        std::cerr << "REUSEPORT_LISTENERS steers by CPU but PIN_THREADS is off, workers may run elsewhere."
+            << std::endl;
     }
+    return true;
 }
 
-void worker_thread(const int thread_id, ThreadResult& result)
+void worker_thread(const int thread_id, ThreadResult& result, const int listen_fd, MetricsReporter& reporter,
+                   const PageStore& pages)
 {
     cout << "Worker thread " << thread_id << " started in " << (config.half_duplex_mode ? "half-duplex" : "full-duplex")
         << " mode." << endl;
@@ -599,52 +1847,107 @@ void worker_thread(const int thread_id, ThreadResult& result)
     int ret;
     struct io_uring ring{};
 
-    if (!setup_io_uring(ring))
+    if (!setup_io_uring(ring, thread_id))
     {
+        worker_rings_ready.fetch_add(1, std::memory_order_release);
         return;
     }
 
+    // Every worker caches its own share of the hot pages, sized by PAGE_CACHE_PAGES and empty without it.
+    const bool direct = config.protocol == "page" && config.page_send_mode == "direct";
+    const uint32_t cache_pages = direct ? config.page_cache_pages : 0;
+    PageCache page_cache(cache_pages, cache_pages > 0 ? pages.page_count() : 0, config.page_size,
+                         DIRECT_HEADER_ROOM);
+    PageCache* cache = page_cache.valid() ? &page_cache : nullptr;
+
+    // Affinity is set by now, so the node the worker runs on is the one its buffers belong on.
+    BufferArena arena(config.use_aligned_allocations ? buffer_arena_size() : 0, config.buffer_huge_pages,
+                      config.buffer_numa_bind ? BufferArena::current_node() : -1, config.alloc_pin);
+    result.buffer_placement = arena.placement();
+
     char* recv_buffers;
     char* send_buffers;
 
-    if (!setup_buffers(ring, recv_buffers, send_buffers))
+    if (!setup_buffers(ring, recv_buffers, send_buffers, cache, arena))
     {
+        worker_rings_ready.fetch_add(1, std::memory_order_release);
         return;
     }
 
-    std::unordered_map<int, int> fd_to_conn_index;
-
-    result.per_second_metrics.resize(config.connections_per_thread);
-
-    auto start_time = std::chrono::steady_clock::now();
+    struct io_uring_buf_ring* buf_ring = nullptr;
+    char* buf_ring_buffers = nullptr;
 
-    while (accepting_connections.load())
+    if (config.multishot_recv && !config.half_duplex_mode)
     {
-        if (connection_fds[thread_id].size() < config.connections_per_thread)
+        if (!setup_buf_ring(ring, buf_ring, buf_ring_buffers))
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            continue;
+            cleanup_buffers(ring, recv_buffers, send_buffers);
+            worker_rings_ready.fetch_add(1, std::memory_order_release);
+            return;
         }
+    }
 
-        cout << "Worker thread " << thread_id << " handling connections" << endl;
+    // Each connection slot owns a fixed share of the inflight buffers, only multishot recv (which sends from
+    // a shared rotation) can serve more connections than the worker was sized for.
+    const uint32_t table_capacity = config.multishot_recv && !config.half_duplex_mode
+                                        ? config.max_connections_per_thread
+                                        : config.connections_per_thread;
+    ConnectionTable connections(&ring, table_capacity, config.fixed_files);
+    if (!connections.register_files())
+    {
+        if (buf_ring)
+        {
+            cleanup_buf_ring(ring, buf_ring, buf_ring_buffers);
+        }
+        cleanup_buffers(ring, recv_buffers, send_buffers);
+        worker_rings_ready.fetch_add(1, std::memory_order_release);
+        return;
+    }
 
-        handle_connection(thread_id, result, ring, recv_buffers, send_buffers, fd_to_conn_index);
+    worker_ring_fds[thread_id] = ring.ring_fd;
+    worker_rings_ready.fetch_add(1, std::memory_order_release);
 
-        if (timer_started.load())
+    // DIRECT_IOPOLL reads pages on a second, polled ring: sockets cannot be polled, so the network side stays on
+    // the worker ring. The disk ring registers the same buffers at the same indices.
+    struct io_uring disk_ring{};
+    struct io_uring* disk = nullptr;
+    if (direct && config.direct_iopoll)
+    {
+        ret = io_uring_queue_init(config.queue_depth, &disk_ring, IORING_SETUP_IOPOLL | IORING_SETUP_SINGLE_ISSUER);
+        if (ret < 0)
         {
-            auto now = std::chrono::steady_clock::now();
-            double elapsed_seconds = std::chrono::duration<double>(now - server_start_time).count();
-            if (elapsed_seconds >= config.run_duration_seconds)
-            {
-                cout << "Time limit reached. Worker thread " << thread_id << " exiting." << endl;
-                break;
-            }
+            std::cerr << "io_uring_queue_init IOPOLL: " << strerror(-ret) << ", reading without polling." << std::endl;
+        }
+        else if (!register_buffers(disk_ring, recv_buffers, send_buffers, cache))
+        {
+            io_uring_queue_exit(&disk_ring);
+        }
+        else
+        {
+            disk = &disk_ring;
         }
     }
 
+    reporter.attach(thread_id, connections, result.per_second_metrics);
+
+    auto start_time = std::chrono::steady_clock::now();
+
+    // Workers that hand connections to each other need every ring fd before the first accept.
+    if (config.multishot_accept && config.accept_policy == "round_robin")
+    {
+        wait_for_worker_rings();
+    }
+
+    cout << "Worker thread " << thread_id << " handling connections" << endl;
+
+    handle_connection(thread_id, result, ring, recv_buffers, send_buffers, buf_ring, buf_ring_buffers,
+                      connections, listen_fd, pages, disk, cache);
+
     auto end_time = std::chrono::steady_clock::now();
     result.duration = std::chrono::duration<double>(end_time - start_time).count();
 
+    reporter.detach(thread_id);
+
     cout << "Worker thread " << thread_id << " processed " << result.total_message_count << " messages in "
         << result.duration << " seconds. Total Throughput: " << (result.total_message_count / result.duration) << " it/s, "
         << ((result.total_bytes_sent + result.total_bytes_received) * 8 / (result.duration * 1e9)) << " Gbit/s."
@@ -652,6 +1955,16 @@ void worker_thread(const int thread_id, ThreadResult& result)
     cout << "Sent throughput: " << (result.total_bytes_sent * 8 / (result.duration * 1e9)) << " Gbit/s." << endl;
     cout << "Recv throughput: " << (result.total_bytes_received * 8 / (result.duration * 1e9)) << " Gbit/s." << endl;
 
+    if (disk)
+    {
+        io_uring_queue_exit(disk);
+    }
+
+    if (buf_ring)
+    {
+        cleanup_buf_ring(ring, buf_ring, buf_ring_buffers);
+    }
+
     cleanup_buffers(ring, recv_buffers, send_buffers);
 
     cout << "Worker thread " << thread_id << " exiting." << endl;
@@ -662,61 +1975,97 @@ int main()
     config.load_from_env();
 
     thread_count = config.thread_count;
-    for (int i = 0; i < thread_count; ++i)
-    {
-        connection_fds.push_back(std::vector<uint16_t>());
-    }
+    worker_ring_fds.assign(thread_count, -1);
 
-    cout << "Server starting..." << endl;
-    int ret;
+    // Only PROTOCOL=page reads pages, echo answers with the zeroed send buffers.
+    const bool page_protocol = config.protocol == "page";
+    request_size = !page_protocol ? 4 : config.page_range_requests ? sizeof(GetPagesRequest) : sizeof(GetPageRequest);
 
-    connection_fds.resize(thread_count);
+    if (page_protocol && config.page_send_mode != "mmap" && config.page_file.empty())
+    {
+        std::cerr << "PAGE_SEND_MODE=" << config.page_send_mode << " needs a PAGE_FILE, sending from memory instead."
+            << std::endl;
+        config.page_send_mode = "mmap";
+    }
+    if (page_protocol && config.page_send_mode == "direct" &&
+        (config.page_size % 512 != 0 || !config.use_aligned_allocations))
+    {
+        std::cerr << "PAGE_SEND_MODE=direct needs a PAGE_SIZE that is a multiple of 512 and aligned allocations, "
+            "sending from memory instead." << std::endl;
+        config.page_send_mode = "mmap";
+    }
+    const bool direct = page_protocol && config.page_send_mode == "direct";
+    if (config.page_cache_pages > 0 && !direct)
+    {
+        std::cerr << "PAGE_CACHE_PAGES only caches pages of PAGE_SEND_MODE=direct, ignoring it." << std::endl;
+        config.page_cache_pages = 0;
+    }
+    send_slot_size = config.page_size + (direct ? DIRECT_HEADER_ROOM : 0);
 
-    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
-    if (listen_fd < 0)
+    PageStore pages(page_protocol ? config.page_count : 0, config.page_size, page_protocol ? config.page_file : "",
+                    config.page_store_huge_pages, config.page_store_populate, direct);
+    if (page_protocol && !pages.valid())
     {
-        perror("socket");
         return 1;
     }
+    if (page_protocol && config.page_checksums && !pages.compute_checksums())
+    {
+        return 1;
+    }
+    if (page_protocol && config.page_send_mode == "splice")
+    {
+        // Two pipe fds per send slot and worker, far beyond the usual soft limit of 1024.
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
 
-    int optval = 1;
-    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
-
-    struct sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(config.port);
-    addr.sin_addr.s_addr = INADDR_ANY;
+    cout << "Server starting..." << endl;
 
-    ret = bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
-    if (ret < 0)
+    // With REUSEPORT_LISTENERS every worker owns one socket of the SO_REUSEPORT group, in worker order.
+    const int listener_count = config.reuseport_listeners ? thread_count : 1;
+    std::vector<int> listen_fds;
+    for (int i = 0; i < listener_count; ++i)
     {
-        perror("bind");
-        close(listen_fd);
-        return 1;
+        int fd = create_listener(config.reuseport_listeners);
+        if (fd < 0)
+        {
+            for (int open_fd : listen_fds)
+            {
+                close(open_fd);
+            }
+            return 1;
+        }
+        listen_fds.push_back(fd);
     }
+    int listen_fd = listen_fds[0];
 
-    ret = listen(listen_fd, SOMAXCONN);
-    if (ret < 0)
+    if (config.reuseport_listeners && !attach_cpu_steering(listen_fd, listener_count))
     {
-        perror("listen");
-        close(listen_fd);
-        return 1;
+        std::cerr << "Falling back to the kernel's hash steering between listeners." << std::endl;
     }
 
     cout << "Server listening on port " << config.port << "." << endl;
 
-    std::thread acceptor(accept_connections, listen_fd);
+    std::thread acceptor;
+    if (!config.multishot_accept)
+    {
+        acceptor = std::thread(accept_connections, listen_fd);
+    }
 
     std::vector<std::thread> workers;
     std::vector<ThreadResult> thread_results(config.thread_count);
-    for (int i = 0; i < config.thread_count; ++i)
-    {
-        thread_results[i].per_second_metrics.resize(config.connections_per_thread);
-    }
+
+    MetricsReporter reporter("Thread", "processed", "messages", config.metrics_interval_ms);
+    reporter.start();
 
     for (int i = 0; i < config.thread_count; ++i)
     {
-        workers.emplace_back(worker_thread, i, std::ref(thread_results[i]));
+        workers.emplace_back(worker_thread, i, std::ref(thread_results[i]), listen_fds[i % listener_count],
+                             std::ref(reporter), std::cref(pages));
     }
 
     for (auto& worker : workers)
@@ -724,6 +2073,8 @@ int main()
         worker.join();
     }
 
+    reporter.stop();
+
     int64_t total_messages_processed = 0;
     int64_t total_bytes_sent = 0;
     int64_t total_bytes_received = 0;
@@ -757,7 +2108,8 @@ int main()
 
     std::string metrics_filename = "report_server_" + datetime_str + ".csv";
     std::ofstream metrics_file(metrics_filename);
-    metrics_file << "timestamp,thread_id,connection_num,message_count,throughput,gbit_per_second\n";
+    metrics_file << "timestamp,thread_id,connection_num,message_count,throughput,gbit_per_second,cache_hits,"
+        "cache_misses,cache_evictions\n";
     for (int thread_id = 0; thread_id < thread_results.size(); ++thread_id)
     {
         const auto& per_second_metrics = thread_results[thread_id].per_second_metrics;
@@ -767,7 +2119,8 @@ int main()
             for (const auto& m : conn_metrics)
             {
                 metrics_file << m.timestamp << "," << thread_id << "," << conn_index << "," << m.message_count << ","
-                    << m.throughput << "," << m.gbit_per_second << "\n";
+                    << m.throughput << "," << m.gbit_per_second << "," << m.cache_hits << "," << m.cache_misses << ","
+                    << m.cache_evictions << "\n";
             }
         }
     }
@@ -776,7 +2129,17 @@ int main()
     std::string config_filename = "report_server_" + datetime_str + "_env";
     config.save_to_file(config_filename);
 
-    close(listen_fd);
+    std::vector<BufferArena::Placement> placements;
+    for (const auto& result : thread_results)
+    {
+        placements.push_back(result.buffer_placement);
+    }
+    BufferArena::save_placements(config_filename, placements);
+
+    for (int fd : listen_fds)
+    {
+        close(fd);
+    }
 
     if (acceptor.joinable())
     {
@@ -0,0 +1,129 @@
+#include "slab_pool.hpp"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+SlabPool::SlabPool(const std::vector<size_t>& sizes, const uint32_t buffers_per_class, const bool pin)
+{
+    std::fill(std::begin(class_for_shift), std::end(class_for_shift), -1);
+
+    std::vector<int> shifts;
+    for (const size_t size : sizes)
+    {
+        // The free list link lives in the free buffers, so no class is smaller than it.
+        shifts.push_back(std::max(shift_of(size), 2));
+    }
+    std::sort(shifts.begin(), shifts.end());
+    shifts.erase(std::unique(shifts.begin(), shifts.end()), shifts.end());
+
+    if ((size_t)shifts.size() * buffers_per_class > UINT16_MAX + 1UL || buffers_per_class == 0)
+    {
+        std::cerr << "SlabPool: " << shifts.size() << " classes of " << buffers_per_class
+                  << " buffers do not fit 16 bit buffer indices." << std::endl;
+        failed = true;
+        return;
+    }
+    if (!shifts.empty() && shifts.back() > 30)
+    {
+        // io_uring registers no buffer larger than 1 GiB.
+        std::cerr << "SlabPool: buffers of " << (1UL << shifts.back()) << " bytes are too large." << std::endl;
+        failed = true;
+        return;
+    }
+
+    for (const int shift : shifts)
+    {
+        SizeClass size_class;
+        size_class.buffer_size = 1u << shift;
+        size_class.first_index = (uint32_t)buffers.size();
+        size_class.slab_size = ((size_t)size_class.buffer_size * buffers_per_class + 4095) / 4096 * 4096;
+        size_class.slab = (char*)std::aligned_alloc(4096, size_class.slab_size);
+        if (!size_class.slab)
+        {
+            perror("aligned_alloc slab");
+            failed = true;
+            return;
+        }
+        if (pin)
+        {
+            size_class.locked = mlock(size_class.slab, size_class.slab_size) == 0;
+            if (!size_class.locked)
+            {
+                perror("mlock slab");
+            }
+        }
+
+        // Linked in index order, so a fresh pool hands its buffers out front to back.
+        for (uint32_t i = 0; i < buffers_per_class; ++i)
+        {
+            buffers.push_back({size_class.slab + (size_t)i * size_class.buffer_size, size_class.buffer_size});
+            buffer_class.push_back((uint8_t)classes.size());
+        }
+        for (uint32_t i = buffers_per_class; i > 0; --i)
+        {
+            const uint32_t index = size_class.first_index + i - 1;
+            next_of(index) = size_class.free_head;
+            size_class.free_head = index;
+        }
+        size_class.free_count = buffers_per_class;
+
+        // Every smaller size without a class of its own is served from the next larger one.
+        for (int s = shift; s >= 0 && class_for_shift[s] < 0; --s)
+        {
+            class_for_shift[s] = (int8_t)classes.size();
+        }
+        classes.push_back(size_class);
+    }
+}
+
+SlabPool::~SlabPool()
+{
+    for (SizeClass& size_class : classes)
+    {
+        if (size_class.locked)
+        {
+            munlock(size_class.slab, size_class.slab_size);
+        }
+        std::free(size_class.slab);
+    }
+}
+
+SlabPool::Handle SlabPool::check_out(const size_t size)
+{
+    const int shift = shift_of(size);
+    if (shift > MAX_SHIFT || failed || class_for_shift[shift] < 0)
+    {
+        return {};
+    }
+    SizeClass& size_class = classes[class_for_shift[shift]];
+    const uint32_t index = size_class.free_head;
+    if (index == NO_BUFFER)
+    {
+        return {};
+    }
+    size_class.free_head = next_of(index);
+    --size_class.free_count;
+    return {(char*)buffers[index].iov_base, size_class.buffer_size, (uint16_t)index};
+}
+
+void SlabPool::check_in(const uint16_t buffer_index)
+{
+    SizeClass& size_class = classes[buffer_class[buffer_index]];
+    next_of(buffer_index) = size_class.free_head;
+    size_class.free_head = buffer_index;
+    ++size_class.free_count;
+}
+
+uint32_t SlabPool::available(const size_t size) const
+{
+    const int shift = shift_of(size);
+    if (shift > MAX_SHIFT || failed || class_for_shift[shift] < 0)
+    {
+        return 0;
+    }
+    return classes[class_for_shift[shift]].free_count;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed set of buffers in power-of-two size classes, each class one slab of equally sized buffers. check_out and
+// check_in are constant time: a size maps to its class with a bit scan, and every class keeps its free buffers in
+// a list linked through the first bytes of the free buffers themselves. Every buffer has an index that is also
+// its position in iovecs(), so after registering those with io_uring_register_buffers a handle's buffer_index is
+// the registered-buffer index for the fixed opcodes.
+//
+// Self-contained so that fast_net's BufferPool builds on it as well. Not thread-safe, one pool per ring.
+class SlabPool
+{
+public:
+    struct Handle
+    {
+        char* data = nullptr;
+        uint32_t size = 0; // of the size class, at least what was asked for
+        uint16_t buffer_index = 0;
+
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+    // One class per power of two the sizes round up to, buffers_per_class buffers in each. pin mlocks the slabs.
+    SlabPool(const std::vector<size_t>& sizes, uint32_t buffers_per_class, bool pin);
+    ~SlabPool();
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    bool valid() const { return !classes.empty() && !failed; }
+
+    // A free buffer of the smallest class that holds size bytes, an empty handle if that class is used up or
+    // size is larger than every class.
+    Handle check_out(size_t size);
+
+    void check_in(uint16_t buffer_index);
+    void check_in(const Handle& handle) { check_in(handle.buffer_index); }
+
+    // Buffers still free in the class that serves size.
+    uint32_t available(size_t size) const;
+
+    const std::vector<struct iovec>& iovecs() const { return buffers; }
+
+private:
+    static constexpr uint32_t NO_BUFFER = UINT32_MAX;
+    static constexpr int MAX_SHIFT = 63;
+
+    struct SizeClass
+    {
+        char* slab = nullptr;
+        size_t slab_size = 0;
+        uint32_t buffer_size = 0;
+        uint32_t first_index = 0; // of its buffers in iovecs()
+        uint32_t free_head = NO_BUFFER;
+        uint32_t free_count = 0;
+        bool locked = false;
+    };
+
+    static int shift_of(const size_t size) { return size <= 1 ? 0 : 64 - __builtin_clzll(size - 1); }
+
+    uint32_t& next_of(const uint32_t index) { return *(uint32_t*)buffers[index].iov_base; }
+
+    std::vector<SizeClass> classes;
+    // Class serving sizes of up to 1 << shift, -1 if none is large enough.
+    int8_t class_for_shift[MAX_SHIFT + 1];
+    std::vector<uint8_t> buffer_class;
+    std::vector<struct iovec> buffers;
+    bool failed = false;
+};
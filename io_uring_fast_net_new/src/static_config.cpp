@@ -56,6 +56,319 @@ void Config::load_from_env()
     const char* env_run_duration_seconds = std::getenv("RUN_DURATION_SECONDS");
     run_duration_seconds = env_run_duration_seconds ? std::stoi(env_run_duration_seconds) : 60;
 
+    const char* env_multishot_recv = std::getenv("MULTISHOT_RECV");
+    multishot_recv = env_multishot_recv ? std::stoi(env_multishot_recv) != 0 : false;
+
+    // Must be a power of two, the provided buffer ring is indexed with a mask.
+    const char* env_buf_ring_entries = std::getenv("BUF_RING_ENTRIES");
+    buf_ring_entries = env_buf_ring_entries ? std::stoi(env_buf_ring_entries) : 512;
+
+    const char* env_buf_ring_buffer_size = std::getenv("BUF_RING_BUFFER_SIZE");
+    buf_ring_buffer_size = env_buf_ring_buffer_size ? std::stoi(env_buf_ring_buffer_size) : 128;
+
+    const char* env_multishot_accept = std::getenv("MULTISHOT_ACCEPT");
+    multishot_accept = env_multishot_accept ? std::stoi(env_multishot_accept) != 0 : false;
+
+    // "balanced": a worker stops accepting once it holds CONNECTIONS_PER_THREAD connections.
+    // "local": every worker keeps accepting and owns whatever its ring accepted.
+    // "round_robin": the accepting worker hands each connection to the next worker via IORING_OP_MSG_RING.
+    const char* env_accept_policy = std::getenv("ACCEPT_POLICY");
+    accept_policy = env_accept_policy ? env_accept_policy : "balanced";
+    if (accept_policy != "balanced" && accept_policy != "local" && accept_policy != "round_robin")
+    {
+        std::cerr << "Unknown ACCEPT_POLICY " << accept_policy << ", using balanced.\n";
+        accept_policy = "balanced";
+    }
+
+    // Each worker accepts on its own SO_REUSEPORT listener and keeps what it accepts.
+    const char* env_reuseport_listeners = std::getenv("REUSEPORT_LISTENERS");
+    reuseport_listeners = env_reuseport_listeners ? std::stoi(env_reuseport_listeners) != 0 : false;
+    if (reuseport_listeners)
+    {
+        multishot_accept = true;
+        accept_policy = "local";
+    }
+
+    // Register connection sockets with the ring and address them by slot index (IOSQE_FIXED_FILE).
+    const char* env_fixed_files = std::getenv("FIXED_FILES");
+    fixed_files = env_fixed_files ? std::stoi(env_fixed_files) != 0 : false;
+
+    // Multishot accept straight into the registered file table, the socket never gets a normal fd.
+    const char* env_accept_direct = std::getenv("ACCEPT_DIRECT");
+    accept_direct = env_accept_direct ? std::stoi(env_accept_direct) != 0 : false;
+    if (accept_direct)
+    {
+        if (!multishot_accept || accept_policy == "round_robin")
+        {
+            std::cerr << "ACCEPT_DIRECT needs MULTISHOT_ACCEPT with a balanced or local policy, disabling it.\n";
+            accept_direct = false;
+        }
+        else
+        {
+            fixed_files = true;
+        }
+    }
+
+    // Size of a worker's connection table when connections don't own inflight slots (multishot recv).
+    const char* env_max_connections_per_thread = std::getenv("MAX_CONNECTIONS_PER_THREAD");
+    max_connections_per_thread = env_max_connections_per_thread ? std::stoi(env_max_connections_per_thread) : 4096;
+    if (max_connections_per_thread < connections_per_thread)
+    {
+        max_connections_per_thread = connections_per_thread;
+    }
+
+    // Smallest send that goes out with send_zc, -1 disables zero-copy. Below roughly 16 KiB pinning the pages
+    // and waiting for the notification costs more than the copy it saves; recalibrate per NIC. With auto each
+    // worker tries both on its first messages of every size and keeps the one that holds the send buffer for less
+    // time per byte, until the notification for send_zc. That is wall time, not CPU time, and noisy under load.
+    const char* env_send_zc_threshold = std::getenv("SEND_ZC_THRESHOLD");
+    send_zc_threshold = !env_send_zc_threshold ? 16384
+        : std::string(env_send_zc_threshold) == "auto" ? SEND_ZC_AUTO
+        : std::stoi(env_send_zc_threshold);
+
+    // Zero-copy sends address the registered send buffers by index (send_zc_fixed) instead of by pointer,
+    // so the kernel skips pinning and mapping the pages on every op.
+    const char* env_fixed_buffers = std::getenv("FIXED_BUFFERS");
+    fixed_buffers = env_fixed_buffers ? std::stoi(env_fixed_buffers) != 0 : true;
+
+    // Most CQEs handled per pass over the completion queue before the head is advanced.
+    const char* env_cqe_batch_size = std::getenv("CQE_BATCH_SIZE");
+    cqe_batch_size = env_cqe_batch_size ? std::stoi(env_cqe_batch_size) : 64;
+    if (cqe_batch_size < 1)
+    {
+        cqe_batch_size = 1;
+    }
+
+    // Kernel submission threads instead of io_uring_enter for submissions.
+    const char* env_sqpoll = std::getenv("SQPOLL");
+    sqpoll = env_sqpoll ? std::stoi(env_sqpoll) != 0 : false;
+
+    // How long an idle poller spins before it sleeps and needs a wakeup syscall again.
+    const char* env_sqpoll_idle_ms = std::getenv("SQPOLL_IDLE_MS");
+    sqpoll_idle_ms = env_sqpoll_idle_ms ? std::stoi(env_sqpoll_idle_ms) : 1000;
+
+    // First CPU for the pollers, poller k runs on SQPOLL_CPU + k. -1 leaves placement to the scheduler.
+    const char* env_sqpoll_cpu = std::getenv("SQPOLL_CPU");
+    sqpoll_cpu = env_sqpoll_cpu ? std::stoi(env_sqpoll_cpu) : -1;
+
+    // Number of pollers the rings of a process share, 0 gives every ring its own.
+    const char* env_sqpoll_threads = std::getenv("SQPOLL_THREADS");
+    sqpoll_threads = env_sqpoll_threads ? std::stoi(env_sqpoll_threads) : 0;
+
+    // NAPI busy poll timeout per wait in microseconds, 0 disables busy polling.
+    const char* env_napi_busy_poll_us = std::getenv("NAPI_BUSY_POLL_US");
+    napi_busy_poll_us = env_napi_busy_poll_us ? std::stoi(env_napi_busy_poll_us) : 0;
+
+    // Keep the device's interrupts masked while the ring polls it (SO_PREFER_BUSY_POLL semantics).
+    const char* env_napi_prefer_busy_poll = std::getenv("NAPI_PREFER_BUSY_POLL");
+    napi_prefer_busy_poll = env_napi_prefer_busy_poll ? std::stoi(env_napi_prefer_busy_poll) != 0 : false;
+
+    // Sampling period of the metrics reporter thread, one CSV row per connection and interval.
+    const char* env_metrics_interval_ms = std::getenv("METRICS_INTERVAL_MS");
+    metrics_interval_ms = env_metrics_interval_ms ? std::stoi(env_metrics_interval_ms) : 1000;
+    if (metrics_interval_ms < 10)
+    {
+        metrics_interval_ms = 10;
+    }
+
+    // closed: every response immediately sends the next request on its slot.
+    // open: requests go out at TARGET_RATE (aggregate over all client threads) no matter how fast responses come
+    // back, and latency counts from each request's intended send time. Full-duplex client only.
+    const char* env_load_mode = std::getenv("LOAD_MODE");
+    load_mode = env_load_mode ? env_load_mode : "closed";
+    if (load_mode != "closed" && load_mode != "open")
+    {
+        std::cerr << "Unknown LOAD_MODE " << load_mode << ", using closed.\n";
+        load_mode = "closed";
+    }
+
+    const char* env_target_rate = std::getenv("TARGET_RATE");
+    target_rate = env_target_rate ? std::stod(env_target_rate) : 100000;
+    if (load_mode == "open" && target_rate <= 0)
+    {
+        std::cerr << "TARGET_RATE must be positive in open-loop mode, using closed.\n";
+        load_mode = "closed";
+    }
+
+    // Spacing of open-loop requests: constant, poisson or onoff (ONOFF_ON_MS of load, then ONOFF_OFF_MS idle).
+    const char* env_arrival_process = std::getenv("ARRIVAL_PROCESS");
+    arrival_process = env_arrival_process ? env_arrival_process : "constant";
+    if (arrival_process != "constant" && arrival_process != "poisson" && arrival_process != "onoff")
+    {
+        std::cerr << "Unknown ARRIVAL_PROCESS " << arrival_process << ", using constant.\n";
+        arrival_process = "constant";
+    }
+
+    const char* env_onoff_on_ms = std::getenv("ONOFF_ON_MS");
+    onoff_on_ms = env_onoff_on_ms ? std::stoi(env_onoff_on_ms) : 100;
+
+    const char* env_onoff_off_ms = std::getenv("ONOFF_OFF_MS");
+    onoff_off_ms = env_onoff_off_ms ? std::stoi(env_onoff_off_ms) : 100;
+
+    // Arrival times are in nanoseconds, so no client thread can be asked for more than one request per ns, also
+    // not during the on periods of onoff arrivals, which run at (on + off) / on times the average rate.
+    const double peak_factor = arrival_process == "onoff" && onoff_on_ms > 0
+        ? (double)(onoff_on_ms + onoff_off_ms) / onoff_on_ms
+        : 1;
+    if (load_mode == "open" && target_rate / thread_count * peak_factor > 1e9)
+    {
+        target_rate = 1e9 * thread_count / peak_factor;
+        std::cerr << "TARGET_RATE needs arrivals under 1 ns apart, using " << target_rate << ".\n";
+    }
+
+    // echo: a 4-byte request is answered by page_size zero bytes.
+    // page: GetPageRequest / GetPageResponse (page_protocol.hpp) against a dataset of PAGE_COUNT pages, with
+    // request ids, status codes and out-of-order responses. Needs requests, so full-duplex only.
+    const char* env_protocol = std::getenv("PROTOCOL");
+    protocol = env_protocol ? env_protocol : "echo";
+    if (protocol != "echo" && protocol != "page")
+    {
+        std::cerr << "Unknown PROTOCOL " << protocol << ", using echo.\n";
+        protocol = "echo";
+    }
+    if (protocol == "page" && half_duplex_mode)
+    {
+        std::cerr << "PROTOCOL=page needs full-duplex mode, using echo.\n";
+        protocol = "echo";
+    }
+
+    const char* env_page_count = std::getenv("PAGE_COUNT");
+    page_count = env_page_count ? std::stoi(env_page_count) : 65536;
+    if (page_count < 1)
+    {
+        page_count = 1;
+    }
+
+    // Dataset file the server maps instead of generating PAGE_COUNT pages, its size then sets the page count.
+    // A missing file is created with the generated pages.
+    const char* env_page_file = std::getenv("PAGE_FILE");
+    page_file = env_page_file ? env_page_file : "";
+
+    // none, thp (madvise(MADV_HUGEPAGE)) or hugetlb (MAP_HUGETLB, for a file only on a hugetlbfs mount).
+    const char* env_page_store_huge_pages = std::getenv("PAGE_STORE_HUGE_PAGES");
+    page_store_huge_pages = env_page_store_huge_pages ? env_page_store_huge_pages : "none";
+    if (page_store_huge_pages != "none" && page_store_huge_pages != "thp" && page_store_huge_pages != "hugetlb")
+    {
+        std::cerr << "Unknown PAGE_STORE_HUGE_PAGES " << page_store_huge_pages << ", using none.\n";
+        page_store_huge_pages = "none";
+    }
+
+    // Fault the whole page store in at startup rather than on the first request of every page.
+    const char* env_page_store_populate = std::getenv("PAGE_STORE_POPULATE");
+    page_store_populate = env_page_store_populate ? std::stoi(env_page_store_populate) != 0 : true;
+
+    // mmap: responses are sent with sendmsg / sendmsg_zc straight from the mapped pages.
+    // splice: pages go from the PAGE_FILE through a pipe into the socket, never mapped into user space.
+    // direct: every page is read from the PAGE_FILE with O_DIRECT into a registered send buffer and sent from
+    // there, for datasets that do not fit in memory.
+    const char* env_page_send_mode = std::getenv("PAGE_SEND_MODE");
+    page_send_mode = env_page_send_mode ? env_page_send_mode : "mmap";
+    if (page_send_mode != "mmap" && page_send_mode != "splice" && page_send_mode != "direct")
+    {
+        std::cerr << "Unknown PAGE_SEND_MODE " << page_send_mode << ", using mmap.\n";
+        page_send_mode = "mmap";
+    }
+
+    // Reads of PAGE_SEND_MODE=direct go to a polled (IORING_SETUP_IOPOLL) ring, which needs a device with poll
+    // queues, e.g. NVMe with nvme.poll_queues set.
+    const char* env_direct_iopoll = std::getenv("DIRECT_IOPOLL");
+    direct_iopoll = env_direct_iopoll ? std::stoi(env_direct_iopoll) != 0 : false;
+
+    // Pages each worker keeps in its page cache in front of a PAGE_SEND_MODE=direct store, 0 reads every page.
+    const char* env_page_cache_pages = std::getenv("PAGE_CACHE_PAGES");
+    page_cache_pages = env_page_cache_pages ? std::stoi(env_page_cache_pages) : 0;
+    if (page_cache_pages < 0)
+    {
+        std::cerr << "Invalid PAGE_CACHE_PAGES " << page_cache_pages << ", caching nothing.\n";
+        page_cache_pages = 0;
+    }
+
+    // Pages backing the registered send and receive buffers: none, thp, 2m or 1g (MAP_HUGETLB, falls back to thp).
+    const char* env_buffer_huge_pages = std::getenv("BUFFER_HUGE_PAGES");
+    buffer_huge_pages = env_buffer_huge_pages ? env_buffer_huge_pages : "none";
+    if (buffer_huge_pages != "none" && buffer_huge_pages != "thp" && buffer_huge_pages != "2m" &&
+        buffer_huge_pages != "1g")
+    {
+        std::cerr << "Unknown BUFFER_HUGE_PAGES " << buffer_huge_pages << ", using none.\n";
+        buffer_huge_pages = "none";
+    }
+
+    // Binds every worker's buffers to the NUMA node of the CPU it runs on, which takes PIN_THREADS to stay put.
+    const char* env_buffer_numa_bind = std::getenv("BUFFER_NUMA_BIND");
+    buffer_numa_bind = env_buffer_numa_bind ? std::stoi(env_buffer_numa_bind) != 0 : false;
+
+    // Client: checks the content of every PROTOCOL=page response against PageStore's generated data.
+    const char* env_verify_pages = std::getenv("VERIFY_PAGES");
+    verify_pages = env_verify_pages ? std::stoi(env_verify_pages) != 0 : false;
+
+    // PROTOCOL=page response headers carry the CRC32C of their page, which the client checks. Server and client
+    // must both set it, the header is 4 bytes longer.
+    const char* env_page_checksums = std::getenv("PAGE_CHECKSUMS");
+    page_checksums = env_page_checksums ? std::stoi(env_page_checksums) != 0 : false;
+
+    // PROTOCOL=page requests are GetPagesRequest ranges, answered with one scatter-gather send per range. Server
+    // and client must both set it, the request is 4 bytes longer.
+    const char* env_page_range_requests = std::getenv("PAGE_RANGE_REQUESTS");
+    page_range_requests = env_page_range_requests ? std::stoi(env_page_range_requests) != 0 : false;
+
+    // Client: consecutive pages every PAGE_RANGE_REQUESTS request asks for.
+    const char* env_pages_per_request = std::getenv("PAGES_PER_REQUEST");
+    pages_per_request = env_pages_per_request ? std::stoi(env_pages_per_request) : 1;
+    if (pages_per_request < 1 || pages_per_request > page_count)
+    {
+        std::cerr << "PAGES_PER_REQUEST must be between 1 and PAGE_COUNT, asking for one page.\n";
+        pages_per_request = 1;
+    }
+    if (pages_per_request > 1 && !page_range_requests)
+    {
+        std::cerr << "PAGES_PER_REQUEST needs PAGE_RANGE_REQUESTS, asking for one page.\n";
+        pages_per_request = 1;
+    }
+
+    // Server: PROTOCOL=page responses go onto a connection's socket one at a time, so the rest of a partial write
+    // never has another response in front of it. 0 lets them overlap, which is faster for spliced pages but only
+    // safe while the socket's send buffer never fills.
+    const char* env_ordered_sends = std::getenv("ORDERED_SENDS");
+    ordered_sends = env_ordered_sends ? std::stoi(env_ordered_sends) != 0 : true;
+
+    // Client: requests for pages at most COALESCE_MAX_GAP pages apart that are queued within COALESCE_WINDOW_US of
+    // each other go out as one PAGE_RANGE_REQUESTS range of up to COALESCE_PAGES pages, the pages of the gaps are
+    // fetched and dropped. 0 sends each request on its own, a window of 0 coalesces what one pass of the event loop
+    // queues.
+    const char* env_coalesce_pages = std::getenv("COALESCE_PAGES");
+    coalesce_pages = env_coalesce_pages ? std::stoi(env_coalesce_pages) : 0;
+    if (coalesce_pages < 0 || coalesce_pages > page_count)
+    {
+        std::cerr << "COALESCE_PAGES must be between 0 and PAGE_COUNT, not coalescing.\n";
+        coalesce_pages = 0;
+    }
+    if (coalesce_pages > 1 && !page_range_requests)
+    {
+        std::cerr << "COALESCE_PAGES needs PAGE_RANGE_REQUESTS, not coalescing.\n";
+        coalesce_pages = 0;
+    }
+    if (coalesce_pages > 1 && pages_per_request > 1)
+    {
+        std::cerr << "COALESCE_PAGES coalesces single page requests, asking for one page.\n";
+        pages_per_request = 1;
+    }
+
+    const char* env_coalesce_max_gap = std::getenv("COALESCE_MAX_GAP");
+    coalesce_max_gap = env_coalesce_max_gap ? std::stoi(env_coalesce_max_gap) : 0;
+    if (coalesce_max_gap < 0)
+    {
+        std::cerr << "COALESCE_MAX_GAP must not be negative, coalescing consecutive pages only.\n";
+        coalesce_max_gap = 0;
+    }
+
+    const char* env_coalesce_window_us = std::getenv("COALESCE_WINDOW_US");
+    coalesce_window_us = env_coalesce_window_us ? std::stoi(env_coalesce_window_us) : 0;
+    if (coalesce_window_us < 0)
+    {
+        std::cerr << "COALESCE_WINDOW_US must not be negative, using 0.\n";
+        coalesce_window_us = 0;
+    }
+
     printf("SERVER_ADDR: %s\n", server_addr.c_str());
     printf("QUEUE_DEPTH: %d\n", queue_depth);
     printf("INFLIGHT_OPS: %d\n", inflight_ops);
@@ -71,6 +384,49 @@ void Config::load_from_env()
     printf("HALF_DUPLEX_MODE: %s\n", half_duplex_mode ? "true" : "false");
     printf("PIN_THREADS: %s\n", pin_threads ? "true" : "false");
     printf("RUN_DURATION_SECONDS: %d\n", run_duration_seconds);
+    printf("MULTISHOT_RECV: %s\n", multishot_recv ? "true" : "false");
+    printf("BUF_RING_ENTRIES: %d\n", buf_ring_entries);
+    printf("BUF_RING_BUFFER_SIZE: %d\n", buf_ring_buffer_size);
+    printf("MULTISHOT_ACCEPT: %s\n", multishot_accept ? "true" : "false");
+    printf("ACCEPT_POLICY: %s\n", accept_policy.c_str());
+    printf("REUSEPORT_LISTENERS: %s\n", reuseport_listeners ? "true" : "false");
+    printf("FIXED_FILES: %s\n", fixed_files ? "true" : "false");
+    printf("ACCEPT_DIRECT: %s\n", accept_direct ? "true" : "false");
+    printf("MAX_CONNECTIONS_PER_THREAD: %d\n", max_connections_per_thread);
+    printf("SEND_ZC_THRESHOLD: %s\n",
+           send_zc_threshold == SEND_ZC_AUTO ? "auto" : std::to_string(send_zc_threshold).c_str());
+    printf("FIXED_BUFFERS: %s\n", fixed_buffers ? "true" : "false");
+    printf("CQE_BATCH_SIZE: %d\n", cqe_batch_size);
+    printf("SQPOLL: %s\n", sqpoll ? "true" : "false");
+    printf("SQPOLL_IDLE_MS: %d\n", sqpoll_idle_ms);
+    printf("SQPOLL_CPU: %d\n", sqpoll_cpu);
+    printf("SQPOLL_THREADS: %d\n", sqpoll_threads);
+    printf("NAPI_BUSY_POLL_US: %d\n", napi_busy_poll_us);
+    printf("NAPI_PREFER_BUSY_POLL: %s\n", napi_prefer_busy_poll ? "true" : "false");
+    printf("METRICS_INTERVAL_MS: %d\n", metrics_interval_ms);
+    printf("LOAD_MODE: %s\n", load_mode.c_str());
+    printf("TARGET_RATE: %.0f\n", target_rate);
+    printf("ARRIVAL_PROCESS: %s\n", arrival_process.c_str());
+    printf("ONOFF_ON_MS: %d\n", onoff_on_ms);
+    printf("ONOFF_OFF_MS: %d\n", onoff_off_ms);
+    printf("PROTOCOL: %s\n", protocol.c_str());
+    printf("PAGE_COUNT: %d\n", page_count);
+    printf("PAGE_FILE: %s\n", page_file.c_str());
+    printf("PAGE_STORE_HUGE_PAGES: %s\n", page_store_huge_pages.c_str());
+    printf("PAGE_STORE_POPULATE: %s\n", page_store_populate ? "true" : "false");
+    printf("PAGE_SEND_MODE: %s\n", page_send_mode.c_str());
+    printf("DIRECT_IOPOLL: %s\n", direct_iopoll ? "true" : "false");
+    printf("PAGE_CACHE_PAGES: %d\n", page_cache_pages);
+    printf("BUFFER_HUGE_PAGES: %s\n", buffer_huge_pages.c_str());
+    printf("BUFFER_NUMA_BIND: %s\n", buffer_numa_bind ? "true" : "false");
+    printf("VERIFY_PAGES: %s\n", verify_pages ? "true" : "false");
+    printf("PAGE_CHECKSUMS: %s\n", page_checksums ? "true" : "false");
+    printf("PAGE_RANGE_REQUESTS: %s\n", page_range_requests ? "true" : "false");
+    printf("PAGES_PER_REQUEST: %d\n", pages_per_request);
+    printf("ORDERED_SENDS: %s\n", ordered_sends ? "true" : "false");
+    printf("COALESCE_PAGES: %d\n", coalesce_pages);
+    printf("COALESCE_MAX_GAP: %d\n", coalesce_max_gap);
+    printf("COALESCE_WINDOW_US: %d\n", coalesce_window_us);
 }
 
 
@@ -98,6 +454,49 @@ void Config::save_to_file(const std::string& filepath) const
     ofs << "HALF_DUPLEX_MODE=" << half_duplex_mode << "\n";
     ofs << "PIN_THREADS=" << pin_threads << "\n";
     ofs << "RUN_DURATION_SECONDS=" << run_duration_seconds << "\n";
+    ofs << "MULTISHOT_RECV=" << multishot_recv << "\n";
+    ofs << "BUF_RING_ENTRIES=" << buf_ring_entries << "\n";
+    ofs << "BUF_RING_BUFFER_SIZE=" << buf_ring_buffer_size << "\n";
+    ofs << "MULTISHOT_ACCEPT=" << multishot_accept << "\n";
+    ofs << "ACCEPT_POLICY=" << accept_policy << "\n";
+    ofs << "REUSEPORT_LISTENERS=" << reuseport_listeners << "\n";
+    ofs << "FIXED_FILES=" << fixed_files << "\n";
+    ofs << "ACCEPT_DIRECT=" << accept_direct << "\n";
+    ofs << "MAX_CONNECTIONS_PER_THREAD=" << max_connections_per_thread << "\n";
+    ofs << "SEND_ZC_THRESHOLD="
+        << (send_zc_threshold == SEND_ZC_AUTO ? "auto" : std::to_string(send_zc_threshold)) << "\n";
+    ofs << "FIXED_BUFFERS=" << fixed_buffers << "\n";
+    ofs << "CQE_BATCH_SIZE=" << cqe_batch_size << "\n";
+    ofs << "SQPOLL=" << sqpoll << "\n";
+    ofs << "SQPOLL_IDLE_MS=" << sqpoll_idle_ms << "\n";
+    ofs << "SQPOLL_CPU=" << sqpoll_cpu << "\n";
+    ofs << "SQPOLL_THREADS=" << sqpoll_threads << "\n";
+    ofs << "NAPI_BUSY_POLL_US=" << napi_busy_poll_us << "\n";
+    ofs << "NAPI_PREFER_BUSY_POLL=" << napi_prefer_busy_poll << "\n";
+    ofs << "METRICS_INTERVAL_MS=" << metrics_interval_ms << "\n";
+    ofs << "LOAD_MODE=" << load_mode << "\n";
+    ofs << "TARGET_RATE=" << target_rate << "\n";
+    ofs << "ARRIVAL_PROCESS=" << arrival_process << "\n";
+    ofs << "ONOFF_ON_MS=" << onoff_on_ms << "\n";
+    ofs << "ONOFF_OFF_MS=" << onoff_off_ms << "\n";
+    ofs << "PROTOCOL=" << protocol << "\n";
+    ofs << "PAGE_COUNT=" << page_count << "\n";
+    ofs << "PAGE_FILE=" << page_file << "\n";
+    ofs << "PAGE_STORE_HUGE_PAGES=" << page_store_huge_pages << "\n";
+    ofs << "PAGE_STORE_POPULATE=" << page_store_populate << "\n";
+    ofs << "PAGE_SEND_MODE=" << page_send_mode << "\n";
+    ofs << "DIRECT_IOPOLL=" << direct_iopoll << "\n";
+    ofs << "PAGE_CACHE_PAGES=" << page_cache_pages << "\n";
+    ofs << "BUFFER_HUGE_PAGES=" << buffer_huge_pages << "\n";
+    ofs << "BUFFER_NUMA_BIND=" << buffer_numa_bind << "\n";
+    ofs << "VERIFY_PAGES=" << verify_pages << "\n";
+    ofs << "PAGE_CHECKSUMS=" << page_checksums << "\n";
+    ofs << "PAGE_RANGE_REQUESTS=" << page_range_requests << "\n";
+    ofs << "PAGES_PER_REQUEST=" << pages_per_request << "\n";
+    ofs << "ORDERED_SENDS=" << ordered_sends << "\n";
+    ofs << "COALESCE_PAGES=" << coalesce_pages << "\n";
+    ofs << "COALESCE_MAX_GAP=" << coalesce_max_gap << "\n";
+    ofs << "COALESCE_WINDOW_US=" << coalesce_window_us << "\n";
 
     ofs.close();
 
@@ -4,6 +4,9 @@
 
 struct Config
 {
+    // send_zc_threshold value that has each worker calibrate it online.
+    static constexpr int SEND_ZC_AUTO = -2;
+
     std::string server_addr;
     int queue_depth;
     int page_size;
@@ -19,6 +22,48 @@ struct Config
     bool half_duplex_mode;
     bool pin_threads;
     int run_duration_seconds;
+    bool multishot_recv;
+    int buf_ring_entries;
+    int buf_ring_buffer_size;
+    bool multishot_accept;
+    std::string accept_policy;
+    bool reuseport_listeners;
+    bool fixed_files;
+    bool accept_direct;
+    int max_connections_per_thread;
+    int send_zc_threshold;
+    bool fixed_buffers;
+    int cqe_batch_size;
+    bool sqpoll;
+    int sqpoll_idle_ms;
+    int sqpoll_cpu;
+    int sqpoll_threads;
+    int napi_busy_poll_us;
+    bool napi_prefer_busy_poll;
+    int metrics_interval_ms;
+    std::string load_mode;
+    double target_rate;
+    std::string arrival_process;
+    int onoff_on_ms;
+    int onoff_off_ms;
+    std::string protocol;
+    int page_count;
+    std::string page_file;
+    std::string page_store_huge_pages;
+    bool page_store_populate;
+    std::string page_send_mode;
+    bool direct_iopoll;
+    int page_cache_pages;
+    std::string buffer_huge_pages;
+    bool buffer_numa_bind;
+    bool verify_pages;
+    bool page_checksums;
+    bool page_range_requests;
+    int pages_per_request;
+    bool ordered_sends;
+    int coalesce_pages;
+    int coalesce_max_gap;
+    int coalesce_window_us;
 
     void load_from_env();
 